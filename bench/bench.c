@@ -0,0 +1,423 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the shipped examples with every engine and optimization level of the
+ * 	interpreter and reports how long they take. Every configuration is run
+ * 	a few times to warm up the caches and then timed repeatedly in a fresh
+ * 	process, whose peak memory use is taken from the kernel.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * A program of the benchmark.
+ */
+typedef struct Benchmark {
+	/*
+	 * The file name of the program in the examples directory.
+	 */
+	const char *name;
+	/*
+	 * The file name of its input in the input directory, or <code>NULL</code>
+	 * 	if it reads no input.
+	 */
+	const char *input;
+} Benchmark;
+
+/*
+ * The programs that are measured.
+ */
+static const Benchmark benchmarks[] = {
+	{ "mandel.bf", NULL },
+	{ "hanoi.bf", NULL },
+	{ "bench.bf", NULL },
+	{ "long.bf", NULL },
+	{ "lost_kingdom.bf", "lost_kingdom.txt" }
+};
+
+/*
+ * The timings of a configuration.
+ */
+typedef struct Result {
+	/*
+	 * The wall times of the runs in seconds, sorted.
+	 */
+	double *times;
+	/*
+	 * The amount of runs.
+	 */
+	int count;
+	/*
+	 * The largest resident set of the runs in kilobytes.
+	 */
+	long peak_rss;
+} Result;
+
+static const char *interpreter = "./brainfuck";
+static const char *example_directory = "examples";
+static const char *input_directory = "bench";
+static const char *output_path = "bench.json";
+static const char *engines = "list,switch,threaded,jit";
+static const char *levels = "0,1,2";
+static int runs = 5;
+static int warmup = 1;
+
+/*
+ * Prints the usage message of this program.
+ */
+void print_usage() {
+	fprintf(stderr, "usage: brainfuck-bench [-bdioEOrwh]\n");
+	fprintf(stderr, "\t-b  the interpreter to measure (./brainfuck)\n");
+	fprintf(stderr, "\t-d  the directory of the examples (examples)\n");
+	fprintf(stderr, "\t-i  the directory of the scripted input (bench)\n");
+	fprintf(stderr, "\t-o  the file the results are written to as JSON (bench.json)\n");
+	fprintf(stderr, "\t-E  the engines, separated by commas (list,switch,threaded,jit)\n");
+	fprintf(stderr, "\t-O  the optimization levels, separated by commas (0,1,2)\n");
+	fprintf(stderr, "\t-r  the amount of timed runs (5)\n");
+	fprintf(stderr, "\t-w  the amount of runs before timing (1)\n");
+	fprintf(stderr, "\t-h  show a help message\n");
+}
+
+/*
+ * Joins a directory and a file name.
+ *
+ * @param directory The directory.
+ * @param name The file name.
+ * @return The path, which must be freed.
+ */
+char * join_path(const char *directory, const char *name) {
+	size_t length = strlen(directory) + strlen(name) + 2;
+	char *path = malloc(length);
+	if (path == NULL) {
+		fprintf(stderr, "error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(path, length, "%s/%s", directory, name);
+	return path;
+}
+
+/*
+ * Reads the whole given file.
+ *
+ * @param path The path of the file.
+ * @param length The pointer the length of the file is stored at.
+ * @return The contents or <code>NULL</code> if the file could not be read.
+ */
+char * read_file(const char *path, size_t *length) {
+	FILE *file = fopen(path, "r");
+	char *contents;
+	int mapped;
+	char *copy;
+	if (file == NULL)
+		return NULL;
+	contents = brainfuck_read_source(file, length, &mapped);
+	fclose(file);
+	if (contents == NULL)
+		return NULL;
+	copy = malloc(*length + 1);
+	if (copy != NULL) {
+		memcpy(copy, contents, *length);
+		copy[*length] = '\0';
+	}
+	brainfuck_release_source(contents, *length, mapped);
+	return copy;
+}
+
+/*
+ * Discards the output of a program whose operations are counted.
+ */
+static size_t discard(const char *buffer, size_t length) {
+	(void) buffer;
+	return length;
+}
+
+/*
+ * Counts the operations the given program executes without optimizations, which
+ * 	is the amount of work every configuration performs, so that their
+ * 	rates can be compared.
+ *
+ * @param path The path of the program.
+ * @param input The input of the program.
+ * @param length The length of the input.
+ * @return The amount of operations or <code>0</code> if they could not be
+ *	counted.
+ */
+unsigned long long count_operations(const char *path, const char *input, size_t length) {
+	FILE *file = fopen(path, "r");
+	BrainfuckState *state;
+	BrainfuckExecutionContext *context;
+	BrainfuckProgram *program = NULL;
+	unsigned long long *counts = NULL;
+	unsigned long long total = 0;
+	size_t n;
+	if (file == NULL)
+		return 0;
+	state = brainfuck_state();
+	context = brainfuck_context(BRAINFUCK_TAPE_SIZE);
+	context->write_handler = &discard;
+	brainfuck_set_input(context, input, length);
+	if (brainfuck_state_parse_stream(state, file) != NULL)
+		program = brainfuck_compile(state->root);
+	if (program != NULL)
+		counts = brainfuck_profile_program(program, context);
+	for (n = 0; counts != NULL && n < program->length; n++)
+		total += counts[n];
+	free(counts);
+	brainfuck_destroy_program(program);
+	brainfuck_destroy_context(context);
+	brainfuck_destroy_state(state);
+	fclose(file);
+	return total;
+}
+
+/*
+ * Runs the interpreter once in a new process.
+ *
+ * @param engine The engine.
+ * @param level The optimization level.
+ * @param program The path of the program.
+ * @param input The path of the input or <code>NULL</code>.
+ * @param seconds The pointer the wall time is stored at.
+ * @param rss The pointer the peak resident set in kilobytes is stored at.
+ * @return <code>0</code> on success, <code>-1</code> if the run failed.
+ */
+int run_once(const char *engine, const char *level, const char *program, const char *input,
+		double *seconds, long *rss) {
+	struct timespec start, end;
+	struct rusage usage;
+	int status;
+	int fd;
+	pid_t pid;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		fd = open(input != NULL ? input : "/dev/null", O_RDONLY);
+		if (fd < 0)
+			_exit(127);
+		dup2(fd, STDIN_FILENO);
+		close(fd);
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			close(fd);
+		}
+		execl(interpreter, interpreter, "-E", engine, "-O", level, program, (char *) NULL);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &usage) < 0)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+	*rss = usage.ru_maxrss;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+ * Orders wall times, shortest first.
+ */
+static int compare_times(const void *a, const void *b) {
+	double first = *(const double *) a;
+	double second = *(const double *) b;
+	return first < second ? -1 : first > second;
+}
+
+/*
+ * Returns the given percentile of the sorted wall times of a result, using the
+ * 	nearest rank.
+ *
+ * @param result The result.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The wall time in seconds.
+ */
+double percentile(const Result *result, int percentile) {
+	int rank = (percentile * result->count + 99) / 100;
+	return result->times[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ * Warms up and times a configuration.
+ *
+ * @param engine The engine.
+ * @param level The optimization level.
+ * @param program The path of the program.
+ * @param input The path of the input or <code>NULL</code>.
+ * @param result The result to fill in.
+ * @return <code>0</code> on success, <code>-1</code> if a run failed.
+ */
+int measure(const char *engine, const char *level, const char *program, const char *input, Result *result) {
+	double seconds;
+	long rss;
+	int i;
+	result->count = 0;
+	result->peak_rss = 0;
+	for (i = 0; i < warmup; i++) {
+		if (run_once(engine, level, program, input, &seconds, &rss) < 0)
+			return -1;
+	}
+	for (i = 0; i < runs; i++) {
+		if (run_once(engine, level, program, input, &seconds, &rss) < 0)
+			return -1;
+		result->times[result->count++] = seconds;
+		if (rss > result->peak_rss)
+			result->peak_rss = rss;
+	}
+	qsort(result->times, result->count, sizeof(double), &compare_times);
+	return 0;
+}
+
+/*
+ * Main entry point of the benchmark.
+ *
+ * @param argc The amount of arguments given.
+ * @param argv The array with arguments.
+ */
+int main(int argc, char *argv[]) {
+	Result result;
+	FILE *output;
+	char *engine_list;
+	char *level_list;
+	char *engine;
+	char *level;
+	char *engine_state;
+	char *level_state;
+	char *program;
+	char *input_path;
+	char *input;
+	size_t input_length;
+	unsigned long long operations;
+	double median;
+	size_t b;
+	int first = 1;
+	int status = EXIT_SUCCESS;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:d:i:o:E:O:r:w:h")) != -1) {
+		switch (c) {
+		case 'b':
+			interpreter = optarg;
+			break;
+		case 'd':
+			example_directory = optarg;
+			break;
+		case 'i':
+			input_directory = optarg;
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'E':
+			engines = optarg;
+			break;
+		case 'O':
+			levels = optarg;
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 'h':
+			print_usage();
+			return EXIT_SUCCESS;
+		default:
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (runs < 1 || warmup < 0) {
+		fprintf(stderr, "error: invalid amount of runs\n");
+		return EXIT_FAILURE;
+	}
+	output = fopen(output_path, "w");
+	result.times = malloc(sizeof(double) * runs);
+	if (output == NULL || result.times == NULL) {
+		fprintf(stderr, "error: failed to write file %s\n", output_path);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(output, "{\n  \"version\": \"%s\",\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"results\": [",
+			BRAINFUCK_VERSION, runs, warmup);
+	printf("%-16s %-9s %2s %10s %10s %10s %10s %14s %10s\n", "program", "engine", "O",
+			"min", "median", "p90", "max", "ops/s", "rss (KiB)");
+	for (b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+		program = join_path(example_directory, benchmarks[b].name);
+		input_path = benchmarks[b].input != NULL ? join_path(input_directory, benchmarks[b].input) : NULL;
+		input_length = 0;
+		input = input_path != NULL ? read_file(input_path, &input_length) : NULL;
+		if (input_path != NULL && input == NULL) {
+			fprintf(stderr, "error: failed to read file %s\n", input_path);
+			status = EXIT_FAILURE;
+			free(program);
+			free(input_path);
+			continue;
+		}
+		operations = count_operations(program, input, input_length);
+		engine_list = strdup(engines);
+		for (engine = strtok_r(engine_list, ",", &engine_state); engine != NULL;
+				engine = strtok_r(NULL, ",", &engine_state)) {
+			level_list = strdup(levels);
+			for (level = strtok_r(level_list, ",", &level_state); level != NULL;
+					level = strtok_r(NULL, ",", &level_state)) {
+				if (measure(engine, level, program, input_path, &result) < 0) {
+					fprintf(stderr, "error: %s failed with -E %s -O %s\n", benchmarks[b].name, engine, level);
+					status = EXIT_FAILURE;
+					continue;
+				}
+				median = percentile(&result, 50);
+				printf("%-16s %-9s %2s %10.4f %10.4f %10.4f %10.4f %14.0f %10ld\n", benchmarks[b].name,
+						engine, level, result.times[0], median, percentile(&result, 90),
+						result.times[result.count - 1], median > 0 ? (double) operations / median : 0.0,
+						result.peak_rss);
+				fflush(stdout);
+				fprintf(output, "%s\n    {\"program\": \"%s\", \"engine\": \"%s\", \"level\": %d, "
+						"\"operations\": %llu, \"min\": %.6f, \"median\": %.6f, \"p90\": %.6f, "
+						"\"max\": %.6f, \"ops_per_second\": %.0f, \"peak_rss_kib\": %ld}",
+						first ? "" : ",", benchmarks[b].name, engine, atoi(level), operations,
+						result.times[0], median, percentile(&result, 90), result.times[result.count - 1],
+						median > 0 ? (double) operations / median : 0.0, result.peak_rss);
+				first = 0;
+			}
+			free(level_list);
+		}
+		free(engine_list);
+		free(input);
+		free(input_path);
+		free(program);
+	}
+	fprintf(output, "\n  ]\n}\n");
+	if (fclose(output) != 0) {
+		fprintf(stderr, "error: failed to write file %s\n", output_path);
+		status = EXIT_FAILURE;
+	}
+	free(result.times);
+	return status;
+}
@@ -19,6 +19,49 @@
 #define BRAINFUCK_VERSION "2.4.1"
 #define BRAINFUCK_CELL_TYPE int
 #define BRAINFUCK_TAPE_SIZE 30000
+#define BRAINFUCK_OUTPUT_BUFFER_SIZE 4096
+#define BRAINFUCK_INPUT_BUFFER_SIZE 4096
+
+/*
+ * The version of the format compiled programs are cached in. It must be
+ * 	increased whenever the operations of compiled programs change.
+ */
+#define BRAINFUCK_CACHE_VERSION 1
+
+/*
+ * The size of a virtual tape in cells and the size of the guard regions on
+ * 	either side of it in bytes.
+ */
+#define BRAINFUCK_VIRTUAL_TAPE_SIZE (1 << 30)
+#define BRAINFUCK_TAPE_GUARD_SIZE (16 << 20)
+
+/*
+ * The largest amount of operations that is executed when a program is
+ * 	evaluated at compile time.
+ */
+#define BRAINFUCK_EVALUATE_BUDGET 4000000
+
+/*
+ * The values a cell can be given when input is read after the end of the input.
+ */
+#define BRAINFUCK_EOF_UNCHANGED 0
+#define BRAINFUCK_EOF_ZERO 1
+#define BRAINFUCK_EOF_MINUS_ONE 2
+
+/*
+ * The delimiter of batches whose records are each preceded by their length as
+ * 	four bytes, most significant first, instead of ending with a character.
+ */
+#define BRAINFUCK_BATCH_LENGTH -1
+
+/*
+ * The amount of inputs that are run in lockstep, one per byte of a vector.
+ */
+#define BRAINFUCK_LANES 16
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define BRAINFUCK_THREADED_DISPATCH 1
+#endif
 
 #define BRAINFUCK_TOKEN_PLUS '+'
 #define BRAINFUCK_TOKEN_MINUS '-'
@@ -29,6 +72,14 @@
 #define BRAINFUCK_TOKEN_LOOP_START '['
 #define BRAINFUCK_TOKEN_LOOP_END ']'
 
+/*
+ * Instruction types that are not part of the language, but are produced by
+ * 	<code>brainfuck_optimize</code> to replace common loops.
+ */
+#define BRAINFUCK_INSTRUCTION_SET 'S'
+#define BRAINFUCK_INSTRUCTION_SCAN 'Z'
+#define BRAINFUCK_INSTRUCTION_MUL 'M'
+
 /*
  * Represents a brainfuck instruction.
  */
@@ -38,10 +89,21 @@ typedef struct BrainfuckInstruction {
 	 *   the value we want.
 	 */
 	unsigned long difference;
+	/*
+	 * The offset of the cell this instruction operates on, relative to the
+	 * 	current cell.
+	 */
+	long offset;
 	/*
 	 * The type of this instruction.
 	 */
 	char type;
+	/*
+	 * The line and column of the first command of this instruction in the
+	 * 	source, counted from 1, or <code>0</code> if it is not known.
+	 */
+	unsigned int line;
+	unsigned int column;
 	/*
 	 * The next instruction in the linked list.
 	 */
@@ -57,6 +119,39 @@ typedef struct BrainfuckInstruction {
 	struct BrainfuckInstruction *loop;
 } BrainfuckInstruction;
 
+/*
+ * A block of memory instructions are allocated from. The blocks of a state are
+ * 	chained together, newest first, and freed at once when the state is
+ * 	destroyed.
+ */
+typedef struct BrainfuckArena {
+	/*
+	 * The block that was allocated before this one.
+	 */
+	struct BrainfuckArena *next;
+	/*
+	 * The amount of instructions that are allocated from this block.
+	 */
+	size_t length;
+	/*
+	 * The amount of instructions this block can hold.
+	 */
+	size_t capacity;
+	/*
+	 * The instructions of this block.
+	 */
+	struct BrainfuckInstruction instructions[];
+} BrainfuckArena;
+
+/*
+ * The callback that will be invoked with a block of buffered output.
+ * 
+ * @param buffer The characters to write.
+ * @param length The amount of characters to write.
+ * @return The amount of characters that are written.
+ */
+typedef size_t (*BrainfuckWriteHandler) (const char *buffer, size_t length);
+
 /*
  * The state structure contains the head and the root of the linked list containing
  * 	the instructions of the program.
@@ -70,6 +165,22 @@ typedef struct BrainfuckState {
  	 * The head instruction of the instruction linked list.
  	 */
 	struct BrainfuckInstruction *head;
+	/*
+	 * The newest block of the arena the instructions of this state are allocated
+	 * 	from, or <code>NULL</code> if its instructions are allocated one by one.
+	 */
+	struct BrainfuckArena *arena;
+	/*
+	 * Whether the instructions are run with cells that wrap around, which is
+	 * 	the default. Loops that can only end by wrapping the current cell
+	 * 	around, such as "[+]", are only rewritten if they do.
+	 */
+	int cell_wrap;
+	/*
+	 * The callback errors in the source are written to, such as a bracket
+	 * 	that has no match, or <code>NULL</code> for the standard error.
+	 */
+	BrainfuckWriteHandler report_handler;
 } BrainfuckState;
 
 /*
@@ -86,6 +197,31 @@ typedef int (*BrainfuckOutputHandler) (int chr);
  */
 typedef int (*BrainfuckInputHandler) (void);
 
+/*
+ * The callback that will be invoked to fill the input buffer.
+ * 
+ * @param buffer The buffer to read into.
+ * @param length The size of the buffer.
+ * @return The amount of characters that are read, <code>0</code> at the
+ *	end of the input or a negative value if no input is available yet.
+ *	Only <code>brainfuck_run</code> waits for more input; the other
+ *	engines treat a negative value as the end of the input.
+ */
+typedef long (*BrainfuckReadHandler) (char *buffer, size_t length);
+
+struct BrainfuckExecutionContext;
+
+/*
+ * The callback that is invoked when a program fails, for example because it
+ * 	leaves the tape. The buffered output is flushed before. The handler
+ * 	must not return; it may leave the execution with <code>longjmp</code>,
+ * 	after which the context can only be destroyed.
+ *
+ * @param context The context of the execution.
+ * @param message The error message, which ends with a newline.
+ */
+typedef void (*BrainfuckErrorHandler) (struct BrainfuckExecutionContext *context, const char *message);
+
 /*
  * This structure is used as a layer between a brainfuck program and
  * 	the outside. It allows control over input, output and memory.
@@ -115,8 +251,468 @@ typedef struct BrainfuckExecutionContext {
 	 * A flag that, if set to true, indicates that execution should stop.
 	 */
 	int shouldStop;
+	/*
+	 * The callback that will be invoked with blocks of buffered output. If this is
+	 * 	<code>NULL</code>, <code>output_handler</code> is invoked for every
+	 * 	character instead. The default writes to the standard output and
+	 * 	is only used while <code>output_handler</code> is the default too.
+	 */
+	BrainfuckWriteHandler write_handler;
+	/*
+	 * The amount of characters in <code>output_buffer</code>.
+	 */
+	size_t output_length;
+	/*
+	 * The output that is not yet passed to <code>write_handler</code>. It is
+	 * 	flushed when it is full, before input is read and when execution ends.
+	 */
+	char output_buffer[BRAINFUCK_OUTPUT_BUFFER_SIZE];
+	/*
+	 * The callback that will be invoked to fill <code>input_buffer</code> once
+	 * 	the input is consumed. If this is <code>NULL</code>,
+	 * 	<code>input_handler</code> is invoked for every character instead.
+	 * 	The default reads lines from the standard input and is only used
+	 * 	while <code>input_handler</code> is the default too.
+	 */
+	BrainfuckReadHandler read_handler;
+	/*
+	 * The input that is read ahead. This points either into
+	 * 	<code>input_buffer</code> or into memory supplied by the caller.
+	 */
+	const char *input;
+	/*
+	 * The amount of characters in <code>input</code>.
+	 */
+	size_t input_length;
+	/*
+	 * The index of the next character in <code>input</code>.
+	 */
+	size_t input_position;
+	/*
+	 * The value a cell is given when input is read after the end of the input;
+	 * 	one of the <code>BRAINFUCK_EOF_*</code> constants.
+	 */
+	int eof_behavior;
+	/*
+	 * The memory mapped file the input is read from or <code>NULL</code>.
+	 */
+	void *input_map;
+	/*
+	 * The size of <code>input_map</code>.
+	 */
+	size_t input_map_size;
+	/*
+	 * The buffer <code>read_handler</code> reads into.
+	 */
+	char input_buffer[BRAINFUCK_INPUT_BUFFER_SIZE];
+	/*
+	 * The reserved memory of a virtual tape, including its guard regions, or
+	 * 	<code>NULL</code> if the tape is allocated normally.
+	 */
+	void *tape_map;
+	/*
+	 * The size of <code>tape_map</code> in bytes.
+	 */
+	size_t tape_map_size;
+	/*
+	 * The width in bits of the cells the accessible part of a virtual tape
+	 * 	is fitted to. The rest of <code>tape_map</code> is a guard region.
+	 */
+	int tape_map_bits;
+	/*
+	 * The width of a cell in bits: 8, 16 or 32. Cells wider than 8 bits are
+	 * 	only supported by the compiled engines.
+	 */
+	int cell_bits;
+	/*
+	 * <code>1</code> if cells wrap around when they leave their range,
+	 * 	<code>0</code> if that terminates the program.
+	 */
+	int cell_wrap;
+	/*
+	 * The index of the operation <code>brainfuck_run</code> continues at.
+	 */
+	size_t program_counter;
+	/*
+	 * The amount of characters the input operation <code>brainfuck_run</code>
+	 * 	waits at still has to read, or <code>0</code>.
+	 */
+	unsigned long input_pending;
+	/*
+	 * The callback that will be invoked when the program fails. If this is
+	 * 	<code>NULL</code>, the error is written to the standard error and
+	 * 	the process exits.
+	 */
+	BrainfuckErrorHandler error_handler;
+	/*
+	 * The checkpoint that is taken or restored last, which the next
+	 * 	checkpoint shares its unchanged pages with, or <code>NULL</code>.
+	 */
+	struct BrainfuckCheckpoint *checkpoint;
+	/*
+	 * The pages of a virtual tape that are written since the last checkpoint,
+	 * 	or <code>NULL</code> if writes are not tracked.
+	 */
+	struct BrainfuckTapeTrack *tape_track;
 } BrainfuckExecutionContext;
 
+/*
+ * A snapshot of the tape, the tape index and the position in the program and
+ * 	its input of a context. The tape is kept in pages that are shared
+ * 	with the other checkpoints of the context as long as they do not
+ * 	change, so a checkpoint only costs the pages that are written since
+ * 	the previous one.
+ */
+typedef struct BrainfuckCheckpoint {
+	/*
+	 * The amount of references to this checkpoint, including the one of the
+	 * 	context that took it last.
+	 */
+	int references;
+	/*
+	 * The size of the tape in bytes and the size of a page.
+	 */
+	size_t size;
+	size_t page_size;
+	/*
+	 * The groups of pages of the tape, <code>NULL</code> for groups that
+	 * 	are zero.
+	 */
+	struct BrainfuckCheckpointLeaf **leaves;
+	size_t leaf_count;
+	/*
+	 * The state of the context.
+	 */
+	int tape_index;
+	int cell_bits;
+	size_t program_counter;
+	unsigned long input_pending;
+	/*
+	 * The input of the context when it is supplied by the caller, and the
+	 * 	position in it.
+	 */
+	const char *input;
+	size_t input_length;
+	size_t input_position;
+} BrainfuckCheckpoint;
+
+/*
+ * The opcodes of a compiled brainfuck program.
+ */
+typedef enum BrainfuckOpcode {
+	/*
+	 * Adds <code>argument</code> to the current cell.
+	 */
+	BRAINFUCK_OP_ADD,
+	/*
+	 * Sets the current cell to <code>argument</code>.
+	 */
+	BRAINFUCK_OP_SET,
+	/*
+	 * Adds the current cell multiplied by <code>argument</code> to the cell at
+	 * 	<code>offset</code>.
+	 */
+	BRAINFUCK_OP_MUL,
+	/*
+	 * Moves the tape index by <code>argument</code> cells until the current
+	 * 	cell is zero.
+	 */
+	BRAINFUCK_OP_SCAN,
+	/*
+	 * Moves the tape index by <code>argument</code> cells.
+	 */
+	BRAINFUCK_OP_MOVE,
+	/*
+	 * Outputs the current cell <code>argument</code> times.
+	 */
+	BRAINFUCK_OP_OUTPUT,
+	/*
+	 * Reads <code>argument</code> characters into the current cell.
+	 */
+	BRAINFUCK_OP_INPUT,
+	/*
+	 * Jumps <code>argument</code> operations forward if the current cell is zero.
+	 */
+	BRAINFUCK_OP_JUMP_ZERO,
+	/*
+	 * Jumps <code>argument</code> operations backward if the current cell is
+	 * 	not zero.
+	 */
+	BRAINFUCK_OP_JUMP_NONZERO,
+	/*
+	 * Ends the program.
+	 */
+	BRAINFUCK_OP_END
+} BrainfuckOpcode;
+
+/*
+ * Represents a single operation of a compiled brainfuck program.
+ */
+typedef struct BrainfuckOperation {
+	/*
+	 * The opcode of this operation.
+	 */
+	int opcode;
+	/*
+	 * The operand of this operation. For jumps this is the distance to the
+	 * 	operation after the matching jump.
+	 */
+	int argument;
+	/*
+	 * The offset of the cell this operation operates on, relative to the
+	 * 	current cell.
+	 */
+	int offset;
+} BrainfuckOperation;
+
+/*
+ * The position of an operation in the source of a program.
+ */
+typedef struct BrainfuckPosition {
+	/*
+	 * The line, counted from 1, or <code>0</code> if it is not known.
+	 */
+	unsigned int line;
+	/*
+	 * The column, counted from 1, or <code>0</code> if it is not known.
+	 */
+	unsigned int column;
+} BrainfuckPosition;
+
+/*
+ * A brainfuck program that is compiled into a flat array of operations.
+ */
+typedef struct BrainfuckProgram {
+	/*
+	 * The operations of this program, terminated by <code>BRAINFUCK_OP_END</code>.
+	 */
+	struct BrainfuckOperation *operations;
+	/*
+	 * The amount of operations in <code>operations</code>, including the
+	 * 	terminating operation.
+	 */
+	size_t length;
+	/*
+	 * The largest distance past the last accessed cell this program may
+	 * 	access, which decides whether it can rely on guard pages.
+	 */
+	size_t reach;
+	/*
+	 * The cache entry <code>operations</code> is mapped from or
+	 * 	<code>NULL</code> if the operations are allocated normally.
+	 */
+	void *map;
+	/*
+	 * The size of <code>map</code> in bytes.
+	 */
+	size_t map_size;
+	/*
+	 * The position in the source of every operation, or <code>NULL</code> if
+	 * 	the program is not compiled with
+	 * 	<code>brainfuck_compile_with_positions</code>.
+	 */
+	struct BrainfuckPosition *positions;
+	/*
+	 * The translations of the operations for the direct-threaded engines
+	 * 	that ran this program, which are kept until the program is
+	 * 	destroyed, or <code>NULL</code>. The operations must not change
+	 * 	once the program has run.
+	 */
+	void *threaded;
+} BrainfuckProgram;
+
+/*
+ * The reasons <code>brainfuck_run</code> returns.
+ */
+typedef enum BrainfuckStatus {
+	/*
+	 * The program ended.
+	 */
+	BRAINFUCK_STATUS_FINISHED,
+	/*
+	 * The fuel is used up before the program ended.
+	 */
+	BRAINFUCK_STATUS_FUEL,
+	/*
+	 * The program waits for input that is not available yet.
+	 */
+	BRAINFUCK_STATUS_INPUT,
+	/*
+	 * Execution is stopped with <code>brainfuck_execution_stop</code>.
+	 */
+	BRAINFUCK_STATUS_STOPPED
+} BrainfuckStatus;
+
+/*
+ * Compiles source that is fed to it in chunks of any size directly into a
+ * 	program, without keeping the source or building instructions.
+ */
+typedef struct BrainfuckParser {
+	/*
+	 * The program that is being built.
+	 */
+	struct BrainfuckProgram *program;
+	/*
+	 * The amount of operations <code>program</code> is able to hold.
+	 */
+	size_t capacity;
+	/*
+	 * The loops that are opened, but not yet closed, innermost last.
+	 */
+	struct BrainfuckParserLoop *loops;
+	size_t depth;
+	size_t allocated;
+	/*
+	 * The command of the run of commands that is not emitted yet, or
+	 * 	<code>0</code> if there is none, and the net amount of the run.
+	 */
+	char run;
+	long amount;
+	/*
+	 * The line and column of the next byte, counted from 1.
+	 */
+	size_t line;
+	size_t column;
+	/*
+	 * Whether an error is found, after which further chunks are ignored.
+	 */
+	int failed;
+	/*
+	 * Whether the program is run with cells that wrap around, which is the
+	 * 	default. Loops such as "[+]" are only rewritten if they do.
+	 */
+	int cell_wrap;
+	/*
+	 * Whether clear, scan and transfer loops are rewritten as they are
+	 * 	closed, which is the default.
+	 */
+	int rewrite;
+	/*
+	 * The callback errors in the source are written to, or <code>NULL</code>
+	 * 	for the standard error.
+	 */
+	BrainfuckWriteHandler report_handler;
+} BrainfuckParser;
+
+/*
+ * An engine that executes a compiled program.
+ *
+ * @param program The program to execute.
+ * @param context The context of the execution.
+ */
+typedef void (*BrainfuckProgramEngine) (struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * One of the inputs that are run in lockstep by <code>brainfuck_lanes_run</code>.
+ */
+typedef struct BrainfuckLane {
+	/*
+	 * The input of the lane and the position of the next character in it.
+	 */
+	const char *input;
+	size_t input_length;
+	size_t input_position;
+	/*
+	 * The output of the lane.
+	 */
+	char *output;
+	size_t output_length;
+	size_t output_capacity;
+	/*
+	 * Whether the lane left the others, either because its control flow
+	 * 	differs or because it needs a check the lanes do not make, and the
+	 * 	operation and tape index it stopped at. Such a lane is finished by
+	 * 	<code>brainfuck_run</code> after <code>brainfuck_lanes_resume</code>.
+	 */
+	int parked;
+	size_t program_counter;
+	long tape_index;
+} BrainfuckLane;
+
+/*
+ * Runs one compiled program over several inputs at once. The tapes of the
+ * 	lanes are interleaved, so the cells with the same index form a vector
+ * 	that every operation updates as a whole, and all lanes share the tape
+ * 	index and the position in the program.
+ */
+typedef struct BrainfuckLanes {
+	/*
+	 * The tapes of the lanes; cell <code>n</code> of lane <code>l</code> is
+	 * 	at <code>tape[n * BRAINFUCK_LANES + l]</code>.
+	 */
+	unsigned char *tape;
+	/*
+	 * The size of the tape of a lane in cells.
+	 */
+	size_t size;
+	/*
+	 * The range of cells that may not be zero.
+	 */
+	size_t low;
+	size_t high;
+	/*
+	 * The lanes and the amount of them that is used.
+	 */
+	BrainfuckLane lanes[BRAINFUCK_LANES];
+	int count;
+} BrainfuckLanes;
+
+/*
+ * A callback that creates the context a thread of a batch runs its records
+ * 	with.
+ *
+ * @return The context or <code>NULL</code> if it could not be created.
+ */
+typedef struct BrainfuckExecutionContext * (*BrainfuckContextFactory) (void);
+
+/*
+ * Runs one compiled program over many independent input records on a pool of
+ * 	threads. Every thread has its own context, whose tape is reset before
+ * 	each record, and the outputs are written in the order of the records.
+ */
+typedef struct BrainfuckBatch {
+	/*
+	 * The program, which is shared by all threads and only read.
+	 */
+	struct BrainfuckProgram *program;
+	/*
+	 * The engine the records are run with.
+	 */
+	BrainfuckProgramEngine engine;
+	/*
+	 * The callback that creates the context of a thread, or <code>NULL</code>
+	 * 	for a context with a tape of <code>BRAINFUCK_TAPE_SIZE</code> cells.
+	 */
+	BrainfuckContextFactory context_factory;
+	/*
+	 * The character every record ends with, which is not part of its input
+	 * 	but is written after its output, or
+	 * 	<code>BRAINFUCK_BATCH_LENGTH</code>. In the latter case the output
+	 * 	of every record is preceded by its length instead.
+	 */
+	int delimiter;
+	/*
+	 * The amount of threads the records are run on.
+	 */
+	int threads;
+	/*
+	 * The callback the outputs are written to, or <code>NULL</code> for the
+	 * 	standard output.
+	 */
+	BrainfuckWriteHandler write_handler;
+	/*
+	 * Whether records are run <code>BRAINFUCK_LANES</code> at a time in
+	 * 	lockstep when the contexts have 8-bit cells that wrap around.
+	 */
+	int lanes;
+	/*
+	 * The amount of records that are run and the amount of those that failed.
+	 * 	The errors of failed records are written to the standard error.
+	 */
+	size_t records;
+	size_t failed;
+} BrainfuckBatch;
+
 /*
  * Creates a new state.
  */
@@ -129,6 +725,101 @@ BrainfuckState * brainfuck_state();
  */
 BrainfuckExecutionContext * brainfuck_context(int);
 
+/*
+ * Allocates a new instruction that is not part of a list. If a state is given,
+ * 	the instruction is allocated from its arena and is freed together with
+ * 	the state, so it must not be destroyed on its own.
+ *
+ * @param state The state to allocate the instruction from or <code>NULL</code>
+ *	to allocate it with <code>malloc</code>.
+ * @return The new instruction.
+ */
+BrainfuckInstruction * brainfuck_allocate_instruction(struct BrainfuckState *);
+
+/*
+ * Creates a new context with a virtual tape. The tape extends
+ * 	<code>BRAINFUCK_VIRTUAL_TAPE_SIZE / 2</code> cells in both directions
+ * 	from the starting cell, and its pages are only committed once they are
+ * 	touched. It is surrounded by guard regions that catch accesses out of
+ * 	bounds, so compiled programs run without bounds checks.
+ *
+ * @return The new context or <code>NULL</code> if virtual tapes are not
+ *	supported on this platform.
+ */
+BrainfuckExecutionContext * brainfuck_context_virtual(void);
+
+/*
+ * Executes the given compiled program with the given engine on the virtual tape
+ * 	of the given context. Accesses that hit a guard region are reported
+ * 	as out of bounds.
+ *
+ * @param program The program you want to execute.
+ * @param context The context, which must have a virtual tape.
+ * @param engine The engine to execute the program with.
+ */
+void brainfuck_guard_run(struct BrainfuckProgram *, struct BrainfuckExecutionContext *,
+	BrainfuckProgramEngine);
+
+/*
+ * Forgets the guarded run of the current thread. This is done before an error
+ * 	handler is invoked, since it may leave the run without returning.
+ */
+void brainfuck_guard_abandon(void);
+
+/*
+ * Fits the accessible part of the virtual tape of the given context to the
+ * 	current width of its cells, so that the guard region follows the last
+ * 	cell. Nothing is done for other tapes.
+ *
+ * @param context The context.
+ */
+void brainfuck_guard_fit(struct BrainfuckExecutionContext *);
+
+/*
+ * Takes a checkpoint of the tape, the tape index and the position in the
+ * 	program and its input of the given context. Pages that did not
+ * 	change since the previous checkpoint of the context are shared with
+ * 	it. Writes to a virtual tape are tracked from the first checkpoint
+ * 	on, so later checkpoints only look at the pages that are written;
+ * 	other tapes are compared with the previous checkpoint. Pending output
+ * 	is flushed first.
+ *
+ * @param context The context.
+ * @return The checkpoint or <code>NULL</code> if it could not be allocated.
+ *	It must be destroyed with <code>brainfuck_destroy_checkpoint</code>.
+ */
+BrainfuckCheckpoint * brainfuck_checkpoint(struct BrainfuckExecutionContext *);
+
+/*
+ * Restores the given checkpoint into the given context, which only rewrites
+ * 	the pages that differ from it on tracked tapes. Input that is supplied
+ * 	by the caller is rewound as well, as long as it is the same input;
+ * 	input from a stream continues where it is and output is not undone.
+ *
+ * @param context The context, whose tape must be as large as the one the
+ *	checkpoint is taken of.
+ * @param checkpoint The checkpoint.
+ * @return <code>0</code> on success, <code>-1</code> if the checkpoint does
+ *	not fit the context.
+ */
+int brainfuck_restore(struct BrainfuckExecutionContext *, struct BrainfuckCheckpoint *);
+
+/*
+ * Releases a checkpoint. Its pages are freed once no other checkpoint shares
+ * 	them.
+ *
+ * @param checkpoint The checkpoint to destroy.
+ */
+void brainfuck_destroy_checkpoint(struct BrainfuckCheckpoint *);
+
+/*
+ * Stops tracking the writes to the tape of the given context and releases its
+ * 	last checkpoint. This is done when the context is destroyed.
+ *
+ * @param context The context.
+ */
+void brainfuck_checkpoint_release(struct BrainfuckExecutionContext *);
+
 /*
  * Removes the given instruction from the linked list.
  * 
@@ -233,6 +924,79 @@ BrainfuckInstruction * brainfuck_parse_substring(char *, int, int);
  */
 BrainfuckInstruction * brainfuck_parse_substring_incremental(char *, int *, int);
 
+/*
+ * Reads instructions from the given stream until EOF occurs and adds them to the
+ * 	given state. Regular files are mapped into memory, other streams are
+ * 	read in large chunks. The instructions are allocated from the arena of
+ * 	the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param stream The stream to read from.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if the stream could not be read or a bracket has no
+ *	match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_stream(struct BrainfuckState *, FILE *);
+
+/*
+ * Reads instructions from the given string and adds them to the given state.
+ * 	The instructions are allocated from the arena of the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param str The string to read from.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if a bracket has no match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_string(struct BrainfuckState *, char *);
+
+/*
+ * Converts the given source into instructions in a single pass and adds them to
+ * 	the given state. Runs of commands are merged even when they are
+ * 	interrupted by comments. The instructions are allocated from the arena
+ * 	of the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param source The source to parse.
+ * @param length The length of the source.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if a bracket has no match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_buffer(struct BrainfuckState *, const char *, size_t);
+
+/*
+ * Reads the whole given stream into memory. Regular files are mapped into
+ * 	memory, other streams are read in large chunks.
+ *
+ * @param stream The stream to read from.
+ * @param length The pointer the length of the source is stored at.
+ * @param mapped The pointer a flag is stored at that tells whether the source
+ *	is mapped into memory.
+ * @return The source or <code>NULL</code> if the stream could not be read.
+ *	It must be released with <code>brainfuck_release_source</code>.
+ */
+char * brainfuck_read_source(FILE *, size_t *, int *);
+
+/*
+ * Releases a source that is read with <code>brainfuck_read_source</code>.
+ *
+ * @param source The source.
+ * @param length The length of the source.
+ * @param mapped The flag that tells whether the source is mapped into memory.
+ */
+void brainfuck_release_source(char *, size_t, int);
+
+/*
+ * Translates the given linked list containing instructions into a
+ * 	self-contained C program that uses a tape of the given size, wraps cells
+ * 	around like <code>brainfuck_execute</code> and buffers its output.
+ *
+ * @param stream The stream to write the C program to.
+ * @param root The start of the linked list of instructions you want to translate.
+ * @param size The size of the tape.
+ * @return <code>0</code> on success, <code>-1</code> if writing failed.
+ */
+int brainfuck_emit_c(FILE *, struct BrainfuckInstruction *, int);
+
 /*
  * Converts the given character to an instruction.
  *
@@ -256,7 +1020,8 @@ void brainfuck_destroy_instruction(struct BrainfuckInstruction *);
 void brainfuck_destroy_instructions(struct BrainfuckInstruction *);
 
 /*
- * Destroys a state.
+ * Destroys a state and its instructions. Instructions that are allocated from
+ * 	the arena of the state are released together with its blocks.
  * 
  * @param state The state to destroy
  */
@@ -269,6 +1034,83 @@ void brainfuck_destroy_state(struct BrainfuckState *);
  */
 void brainfuck_destroy_context(struct BrainfuckExecutionContext *);
 
+/*
+ * Writes the buffered output of the given context to its write handler.
+ *
+ * @param context The context whose output to flush.
+ */
+void brainfuck_flush(struct BrainfuckExecutionContext *);
+
+/*
+ * Outputs the given character the given amount of times. The output is
+ * 	buffered if the context has a write handler and is otherwise passed
+ * 	to its output handler one character at a time.
+ *
+ * @param context The context of the execution.
+ * @param chr The character to output.
+ * @param count The amount of times to output the character.
+ */
+void brainfuck_output(struct BrainfuckExecutionContext *, int, unsigned long);
+
+/*
+ * Reads the next character of input. Only when the input that is read ahead
+ * 	is consumed is the buffered output flushed and the input refilled.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell, which is kept at the end of
+ *	the input if the context asks for it.
+ * @return The character that is read.
+ */
+int brainfuck_input(struct BrainfuckExecutionContext *, int);
+
+/*
+ * Reads the next character of input unless the read handler reports that no
+ * 	input is available yet.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell, which is kept at the end of
+ *	the input if the context asks for it.
+ * @param value The pointer the character that is read is stored at.
+ * @return <code>1</code> if a character is read, <code>0</code> if the
+ *	program has to wait for input.
+ */
+int brainfuck_input_poll(struct BrainfuckExecutionContext *, int, int *);
+
+/*
+ * Makes the given context read its input directly from the given memory,
+ * 	without copying it. The input ends at the end of the memory.
+ *
+ * @param context The context.
+ * @param input The memory to read from, which must outlive the execution.
+ * @param length The amount of characters in the memory.
+ */
+void brainfuck_set_input(struct BrainfuckExecutionContext *, const char *, size_t);
+
+/*
+ * Makes the given context read its input directly from the given memory,
+ * 	like <code>brainfuck_set_input</code>, but once the memory is consumed
+ * 	<code>brainfuck_run</code> waits for more input instead of reaching the
+ * 	end of the input. Pass <code>NULL</code> to
+ * 	<code>brainfuck_set_input</code> to end the input.
+ *
+ * @param context The context.
+ * @param input The memory to read from, which must outlive the execution.
+ * @param length The amount of characters in the memory.
+ */
+void brainfuck_supply_input(struct BrainfuckExecutionContext *, const char *, size_t);
+
+/*
+ * Makes the given context read its input directly from the given file by
+ * 	mapping it into memory. The mapping is released when the context is
+ * 	destroyed.
+ *
+ * @param context The context.
+ * @param file The file to read from.
+ * @return <code>0</code> on success, <code>-1</code> if the file could not
+ *	be mapped.
+ */
+int brainfuck_map_input(struct BrainfuckExecutionContext *, FILE *);
+
 /*
  * Executes the given linked list containing instructions.
  *
@@ -279,6 +1121,413 @@ void brainfuck_destroy_context(struct BrainfuckExecutionContext *);
  */
 void brainfuck_execute(struct BrainfuckInstruction *, struct BrainfuckExecutionContext *);
 
+/*
+ * A brainfuck program that is compiled into native machine code.
+ */
+typedef struct BrainfuckJitProgram {
+	/*
+	 * The executable memory containing the machine code.
+	 */
+	void *code;
+	/*
+	 * The entry point of the machine code.
+	 */
+	void *entry;
+	/*
+	 * The size of the executable memory in bytes.
+	 */
+	size_t size;
+} BrainfuckJitProgram;
+
+/*
+ * Rewrites common loops in the instruction list of the given state into
+ * 	single instructions: clear loops such as "[-]" become
+ * 	<code>BRAINFUCK_INSTRUCTION_SET</code>, scan loops such as "[>]" become
+ * 	<code>BRAINFUCK_INSTRUCTION_SCAN</code> and balanced transfer loops such
+ * 	as "[->+>++<<]" become a sequence of <code>BRAINFUCK_INSTRUCTION_MUL</code>
+ * 	followed by a <code>BRAINFUCK_INSTRUCTION_SET</code>.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of loops that are rewritten.
+ */
+int brainfuck_optimize(struct BrainfuckState *);
+
+/*
+ * Folds pointer movement into the offsets of the instructions in the given
+ * 	state, so that every basic block addresses its cells relative to the
+ * 	pointer at the start of the block and moves the pointer only once at
+ * 	its end. This pass should run after <code>brainfuck_optimize</code>.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of instructions that are removed.
+ */
+int brainfuck_optimize_offsets(struct BrainfuckState *);
+
+/*
+ * Removes instructions that can not affect the program in the given state,
+ * 	tracking the values of cells through the program: loops that are
+ * 	never entered, such as comment loops at the start of the program and
+ * 	loops that directly follow another loop, additions that cancel out,
+ * 	writes that are overwritten before they are read and clears of cells
+ * 	that are already zero. The program is assumed to start on a tape of
+ * 	zeros. This pass can run after any of the other passes.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of instructions that are removed.
+ */
+int brainfuck_optimize_dead(struct BrainfuckState *);
+
+/*
+ * Finds the next zero cell on the tape, starting at the given index and moving
+ * 	by the given stride. Vectorized kernels are selected at runtime based on
+ * 	the features of the processor.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or, if the scan runs off the tape, the
+ *	first index that is out of bounds.
+ */
+long brainfuck_scan(const char *, size_t, long, long);
+
+/*
+ * Compiles the given linked list containing instructions into a flat array of
+ * 	operations with resolved jump targets.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckProgram * brainfuck_compile(struct BrainfuckInstruction *);
+
+/*
+ * Compiles the given linked list containing instructions like
+ * 	<code>brainfuck_compile</code> and records the source position of every
+ * 	operation, so that profiles can be traced back to the source.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckProgram * brainfuck_compile_with_positions(struct BrainfuckInstruction *);
+
+/*
+ * Executes the given compiled program using the fastest engine available.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program(struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Executes the given compiled program using a portable <code>switch</code>
+ * 	dispatch loop.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program_switch(struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Executes the given compiled program using direct-threaded dispatch. Falls
+ * 	back to <code>brainfuck_execute_program_switch</code> if the compiler
+ * 	does not support labels as values.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program_threaded(struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Executes the given compiled program from where the previous call stopped
+ * 	until it ends, the given fuel is used up or it waits for input. The
+ * 	budget is only checked when a loop repeats, where every iteration costs
+ * 	the length of its body, so straight-line code runs without any checks.
+ * 	The position in the program is kept in the context, which must not be
+ * 	used for another program until this one has finished.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ * @param fuel The amount of operations that may be executed or a negative
+ *	value for no limit.
+ * @return The reason execution stopped.
+ */
+BrainfuckStatus brainfuck_run(struct BrainfuckProgram *, struct BrainfuckExecutionContext *, long);
+
+/*
+ * Executes the given compiled program with a variant of the <code>switch</code>
+ * 	engine that counts how often every operation is executed. The other
+ * 	engines do not count anything, so they run at full speed.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ * @return The amount of executions of every operation, indexed like the
+ *	operations of the program, or <code>NULL</code> if it could not be
+ *	allocated. It must be freed with <code>free</code>.
+ */
+unsigned long long * brainfuck_profile_program(struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Writes a report of the loops of the given program that execute the most
+ * 	operations, together with their source text, the amount of times
+ * 	they repeat and their share of all executed operations.
+ *
+ * @param stream The stream to write the report to.
+ * @param program The program, which must be compiled with positions.
+ * @param counts The counts returned by <code>brainfuck_profile_program</code>.
+ * @param source The source of the program.
+ * @param length The length of the source.
+ * @param top The largest amount of loops to report.
+ * @return <code>0</code> on success, <code>-1</code> if writing failed.
+ */
+int brainfuck_profile_report(FILE *, struct BrainfuckProgram *, const unsigned long long *,
+	const char *, size_t, int);
+
+/*
+ * Checks that the operations of the given program are well formed, so that it
+ * 	can be executed safely although it is not compiled by
+ * 	<code>brainfuck_compile</code>, and computes its reach.
+ *
+ * @param program The program to check.
+ * @return <code>0</code> if the program is well formed, <code>-1</code>
+ *	otherwise.
+ */
+int brainfuck_validate_program(struct BrainfuckProgram *);
+
+/*
+ * Executes the part of the given compiled program that does not depend on its
+ * 	input at compile time and replaces it by operations that write its
+ * 	output at once and restore the tape it leaves behind.
+ *
+ * @param program The program to evaluate. Programs that are mapped from the
+ *	cache are left alone.
+ * @param context The context the program is executed with, whose tape must
+ *	still be zero. The result is only valid for contexts with the same
+ *	cells.
+ * @param budget The largest amount of operations that is executed.
+ * @return The amount of operations that are replaced, <code>0</code> if
+ *	nothing could be evaluated or <code>-1</code> on failure.
+ */
+long brainfuck_evaluate(struct BrainfuckProgram *, struct BrainfuckExecutionContext *, unsigned long);
+
+/*
+ * Destroys a compiled program.
+ * 
+ * @param program The program to destroy.
+ */
+void brainfuck_destroy_program(struct BrainfuckProgram *);
+
+/*
+ * Creates a parser that compiles source that is fed to it in chunks. Clear,
+ * 	scan and transfer loops are rewritten as they are closed, so the
+ * 	memory it uses grows with the compiled program rather than with the
+ * 	source.
+ *
+ * @return The parser or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckParser * brainfuck_parser();
+
+/*
+ * Feeds the next chunk of source to the given parser. Chunks may end anywhere,
+ * 	including inside a run of commands or a loop.
+ *
+ * @param parser The parser.
+ * @param chunk The chunk.
+ * @param length The length of the chunk.
+ * @return <code>0</code> on success, <code>-1</code> if a bracket has no
+ *	match or memory could not be allocated.
+ */
+int brainfuck_parser_feed(struct BrainfuckParser *, const char *, size_t);
+
+/*
+ * Completes the program of the given parser once all source is fed to it.
+ *
+ * @param parser The parser, which must still be destroyed afterwards.
+ * @return The program, which is no longer owned by the parser, or
+ *	<code>NULL</code> if a bracket has no match or memory could not be
+ *	allocated.
+ */
+BrainfuckProgram * brainfuck_parser_finish(struct BrainfuckParser *);
+
+/*
+ * Destroys a parser and the program it is building, unless it is finished.
+ *
+ * @param parser The parser to destroy.
+ */
+void brainfuck_destroy_parser(struct BrainfuckParser *);
+
+/*
+ * Creates the lanes to run programs in lockstep with.
+ *
+ * @param size The size of the tape of every lane in cells.
+ * @return The lanes or <code>NULL</code> if they could not be allocated.
+ */
+BrainfuckLanes * brainfuck_lanes(size_t);
+
+/*
+ * Runs the given program over the inputs of the first <code>count</code> lanes
+ * 	of the given lanes at once, on 8-bit cells that wrap around. Every
+ * 	lane starts at the tape index of the given context on a zero tape and
+ * 	reads its input like the context would. A lane whose loop condition
+ * 	or scan differs from the majority, or that would leave the tape, is
+ * 	parked where it is and the others go on. Once fewer than half of the
+ * 	lanes are left, those are parked as well.
+ *
+ * @param lanes The lanes, whose inputs are set.
+ * @param program The program.
+ * @param context The context whose tape index and end of input behavior are
+ *	used; its tape must be as large as that of the lanes.
+ * @return <code>0</code> on success, <code>-1</code> if the cells of the
+ *	context are not supported or output could not be allocated.
+ */
+int brainfuck_lanes_run(struct BrainfuckLanes *, struct BrainfuckProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Moves a parked lane into the given context, so that
+ * 	<code>brainfuck_run</code> finishes it with the tape, tape index,
+ * 	position in the program and input it stopped at.
+ *
+ * @param lanes The lanes.
+ * @param lane The index of the lane, which must be parked.
+ * @param context The context, whose tape must be zero.
+ * @return <code>0</code> on success, <code>-1</code> if the lane is not
+ *	parked or the context does not fit.
+ */
+int brainfuck_lanes_resume(struct BrainfuckLanes *, int, struct BrainfuckExecutionContext *);
+
+/*
+ * Destroys lanes and the outputs of their lanes.
+ *
+ * @param lanes The lanes to destroy.
+ */
+void brainfuck_destroy_lanes(struct BrainfuckLanes *);
+
+/*
+ * Creates a batch that runs the given program with the threaded engine on as
+ * 	many threads as there are processors, over records that end with a
+ * 	newline.
+ *
+ * @param program The program.
+ * @return The batch or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckBatch * brainfuck_batch(struct BrainfuckProgram *);
+
+/*
+ * Runs the program of the given batch over every record of the given input.
+ * 	A record fails when its program reports an error, such as leaving the
+ * 	tape, after which the next record runs on a fresh tape.
+ *
+ * @param batch The batch.
+ * @param input The records.
+ * @param length The length of the input.
+ * @return <code>0</code> if all records succeeded, <code>-1</code> if any of
+ *	them failed or no context could be created.
+ */
+int brainfuck_batch_run(struct BrainfuckBatch *, const char *, size_t);
+
+/*
+ * Destroys a batch, but not its program.
+ *
+ * @param batch The batch to destroy.
+ */
+void brainfuck_destroy_batch(struct BrainfuckBatch *);
+
+/*
+ * Computes the key a compiled program is cached under from its source, the
+ * 	optimizations it is compiled with and the version of this library and
+ * 	of the cache format, and the cells it is compiled for, since loops
+ * 	are only rewritten if their cells wrap and programs that are
+ * 	evaluated at compile time depend on the width of the cells.
+ *
+ * @param source The source of the program.
+ * @param length The length of the source.
+ * @param level The optimization level.
+ * @param bits The width of the cells in bits.
+ * @param wrap Whether the cells wrap around.
+ * @return The key.
+ */
+unsigned long long brainfuck_cache_key(const char *, size_t, int, int, int);
+
+/*
+ * Loads the compiled program that is cached under the given key in the given
+ * 	directory. The entry is mapped into memory where possible.
+ *
+ * @param directory The cache directory.
+ * @param key The key of the program.
+ * @return The program or <code>NULL</code> if there is no valid entry.
+ */
+BrainfuckProgram * brainfuck_cache_load(const char *, unsigned long long);
+
+/*
+ * Stores the given compiled program in the given directory under the given
+ * 	key. The entry is written to a temporary file first and then renamed,
+ * 	so concurrent readers never see a partial entry.
+ *
+ * @param directory The cache directory, which is created if it does not exist.
+ * @param key The key of the program.
+ * @param program The program to store.
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+int brainfuck_cache_store(const char *, unsigned long long, struct BrainfuckProgram *);
+
+/*
+ * Reports that the tape index went out of bounds and terminates the program.
+ *
+ * @param context The context of the execution.
+ * @param index The tape index that is out of bounds.
+ */
+void brainfuck_out_of_bounds(struct BrainfuckExecutionContext *, long);
+
+/*
+ * Reports that a cell left its range while cells do not wrap around and
+ * 	terminates the program.
+ *
+ * @param context The context of the execution.
+ * @param value The value the cell would have had.
+ */
+void brainfuck_overflow(struct BrainfuckExecutionContext *, long long);
+
+/*
+ * Translates the given linked list containing instructions into native
+ * 	machine code. Only x86-64 is supported; on other architectures this
+ * 	function returns <code>NULL</code> and the program should be executed
+ * 	by the interpreter instead.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be compiled.
+ */
+BrainfuckJitProgram * brainfuck_jit_compile(struct BrainfuckInstruction *);
+
+/*
+ * Translates the given compiled program into native machine code, like
+ * 	<code>brainfuck_jit_compile</code>.
+ *
+ * @param program The compiled program you want to translate.
+ * @return The translated program or <code>NULL</code> if it could not be
+ *	translated.
+ */
+BrainfuckJitProgram * brainfuck_jit_compile_program(struct BrainfuckProgram *);
+
+/*
+ * Executes the given natively compiled program.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_jit_run(struct BrainfuckJitProgram *, struct BrainfuckExecutionContext *);
+
+/*
+ * Destroys a natively compiled program.
+ * 
+ * @param program The program to destroy.
+ */
+void brainfuck_destroy_jit(struct BrainfuckJitProgram *);
+
 /*
  * Stops the currently running program referenced by the given execution context.
  *
@@ -0,0 +1,687 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_BATCH_THREADS 1
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define BRAINFUCK_THREAD_LOCAL __thread
+#else
+#	define BRAINFUCK_THREAD_LOCAL
+#endif
+
+/*
+ * The largest amount of records a thread takes at once.
+ */
+#define BRAINFUCK_BATCH_CHUNK 256
+
+/*
+ * The amount of chunks per thread that may be taken before the chunk that is
+ * 	written next is finished, which bounds the memory of the outputs.
+ */
+#define BRAINFUCK_BATCH_WINDOW 4
+
+/*
+ * A range of records that is run by one thread.
+ */
+typedef struct BrainfuckBatchChunk {
+	/*
+	 * The records and the index of the first of them.
+	 */
+	const char *begin;
+	const char *end;
+	size_t first;
+	/*
+	 * The outputs of the records, one after the other.
+	 */
+	char *output;
+	size_t output_length;
+	size_t output_capacity;
+	/*
+	 * The errors of the records that failed.
+	 */
+	char *errors;
+	size_t errors_length;
+	size_t errors_capacity;
+	/*
+	 * The amount of records that are run and the amount of those that failed.
+	 */
+	size_t records;
+	size_t failed;
+	/*
+	 * A flag that is set once all records of the chunk are run.
+	 */
+	int done;
+} BrainfuckBatchChunk;
+
+/*
+ * A thread of a batch and the context it runs its records with.
+ */
+typedef struct BrainfuckBatchWorker {
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_t thread;
+#endif
+	struct BrainfuckBatchRun *run;
+	BrainfuckExecutionContext *context;
+	/*
+	 * The fresh state of the context, which is restored before every record.
+	 */
+	BrainfuckCheckpoint *checkpoint;
+	/*
+	 * The lanes the records are run with in lockstep or <code>NULL</code> if
+	 * 	they are run one by one.
+	 */
+	BrainfuckLanes *lanes;
+} BrainfuckBatchWorker;
+
+/*
+ * The state of a batch that is running.
+ */
+typedef struct BrainfuckBatchRun {
+	BrainfuckBatch *batch;
+	/*
+	 * The input that is not yet taken.
+	 */
+	const char *position;
+	const char *end;
+	/*
+	 * The chunks that are taken and not yet written. Chunk <code>n</code> is
+	 * 	kept at <code>chunks[n % window]</code>.
+	 */
+	BrainfuckBatchChunk *chunks;
+	size_t window;
+	/*
+	 * The amount of chunks that are taken and that are written, and the index
+	 * 	of the next record.
+	 */
+	size_t taken;
+	size_t written;
+	size_t record;
+	/*
+	 * A flag that is set once all input is taken.
+	 */
+	int finished;
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+#endif
+} BrainfuckBatchRun;
+
+/*
+ * The chunk the current thread runs and the point its failed records return to.
+ */
+static BRAINFUCK_THREAD_LOCAL BrainfuckBatchChunk *brainfuck_batch_current;
+static BRAINFUCK_THREAD_LOCAL jmp_buf *brainfuck_batch_jump;
+
+static void brainfuck_batch_lock(BrainfuckBatchRun *run) {
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_mutex_lock(&run->lock);
+#else
+	(void) run;
+#endif
+}
+
+static void brainfuck_batch_unlock(BrainfuckBatchRun *run) {
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_mutex_unlock(&run->lock);
+#else
+	(void) run;
+#endif
+}
+
+/*
+ * Waits until another thread changes the given run, which must be locked.
+ */
+static void brainfuck_batch_wait(BrainfuckBatchRun *run) {
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_cond_wait(&run->changed, &run->lock);
+#else
+	(void) run;
+#endif
+}
+
+/*
+ * Wakes the threads that wait for the given run to change.
+ */
+static void brainfuck_batch_notify(BrainfuckBatchRun *run) {
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_cond_broadcast(&run->changed);
+#else
+	(void) run;
+#endif
+}
+
+/*
+ * Appends the given characters to a growing buffer.
+ *
+ * @param buffer The buffer.
+ * @param length The length of the buffer.
+ * @param capacity The capacity of the buffer.
+ * @param data The characters to append.
+ * @param size The amount of characters to append.
+ * @return <code>0</code> on success, <code>-1</code> if the buffer could not
+ *	grow.
+ */
+static int brainfuck_batch_append(char **buffer, size_t *length, size_t *capacity, const char *data, size_t size) {
+	size_t grown = *capacity;
+	char *memory;
+	if (*length + size > grown) {
+		while (*length + size > grown)
+			grown = grown == 0 ? BRAINFUCK_OUTPUT_BUFFER_SIZE : grown * 2;
+		memory = realloc(*buffer, grown);
+		if (memory == NULL)
+			return -1;
+		*buffer = memory;
+		*capacity = grown;
+	}
+	memcpy(*buffer + *length, data, size);
+	*length += size;
+	return 0;
+}
+
+/*
+ * Records that the current record of the given chunk failed.
+ *
+ * @param chunk The chunk.
+ * @param message The error message, which ends with a newline.
+ */
+static void brainfuck_batch_error(BrainfuckBatchChunk *chunk, const char *message) {
+	char prefix[64];
+	int length = snprintf(prefix, sizeof(prefix), "record %lu: ", (unsigned long) (chunk->first + chunk->records + 1));
+	// the count is all that is left when even the message does not fit
+	if (brainfuck_batch_append(&chunk->errors, &chunk->errors_length, &chunk->errors_capacity, prefix, length) == 0)
+		brainfuck_batch_append(&chunk->errors, &chunk->errors_length, &chunk->errors_capacity, message, strlen(message));
+	chunk->failed++;
+}
+
+/*
+ * Appends output to the chunk of the current thread.
+ *
+ * @param buffer The characters to write.
+ * @param length The amount of characters to write.
+ * @return The amount of characters that are written.
+ */
+static size_t brainfuck_batch_write(const char *buffer, size_t length) {
+	BrainfuckBatchChunk *chunk = brainfuck_batch_current;
+	if (brainfuck_batch_append(&chunk->output, &chunk->output_length, &chunk->output_capacity, buffer, length) < 0) {
+		brainfuck_batch_error(chunk, "error: out of memory\n");
+		longjmp(*brainfuck_batch_jump, 1);
+	}
+	return length;
+}
+
+/*
+ * Records the error of the record the current thread runs and abandons it.
+ *
+ * @param context The context of the record.
+ * @param message The error message.
+ */
+static void brainfuck_batch_fail(BrainfuckExecutionContext *context, const char *message) {
+	(void) context;
+	brainfuck_batch_error(brainfuck_batch_current, message);
+	longjmp(*brainfuck_batch_jump, 1);
+}
+
+/*
+ * Finds the record at the given position of the input.
+ *
+ * @param delimiter The delimiter of the records.
+ * @param position The position of the record.
+ * @param end The end of the input.
+ * @param record The pointer the record is stored at, which is
+ *	<code>NULL</code> if it is cut off by the end of the input.
+ * @param length The pointer the length of the record is stored at.
+ * @return The position of the next record.
+ */
+static const char * brainfuck_batch_next(int delimiter, const char *position, const char *end,
+		const char **record, size_t *length) {
+	const unsigned char *prefix = (const unsigned char *) position;
+	const char *found;
+	size_t size;
+	if (delimiter != BRAINFUCK_BATCH_LENGTH) {
+		found = memchr(position, delimiter, (size_t) (end - position));
+		*record = position;
+		*length = (size_t) ((found != NULL ? found : end) - position);
+		return found != NULL ? found + 1 : end;
+	}
+	*record = NULL;
+	*length = 0;
+	if (end - position < 4)
+		return end;
+	size = (size_t) prefix[0] << 24 | (size_t) prefix[1] << 16 | (size_t) prefix[2] << 8 | prefix[3];
+	if (size > (size_t) (end - position) - 4)
+		return end;
+	*record = position + 4;
+	*length = size;
+	return position + 4 + size;
+}
+
+/*
+ * Runs one record with the given context, starting from a fresh tape or from
+ * 	where its lane was parked.
+ *
+ * @param batch The batch.
+ * @param worker The thread that runs the record.
+ * @param record The input of the record.
+ * @param length The length of the input.
+ * @param lane The index of the parked lane of the record or <code>-1</code>
+ *	if it is run from the start.
+ * @return <code>0</code> on success, <code>-1</code> if the record failed.
+ */
+static int brainfuck_batch_record(BrainfuckBatch *batch, BrainfuckBatchWorker *worker, const char *record,
+		size_t length, int lane) {
+	jmp_buf jump;
+	brainfuck_restore(worker->context, worker->checkpoint);
+	if (lane < 0)
+		brainfuck_set_input(worker->context, record, length);
+	else if (brainfuck_lanes_resume(worker->lanes, lane, worker->context) < 0)
+		return -1;
+	brainfuck_batch_jump = &jump;
+	if (setjmp(jump) != 0)
+		return -1;
+	if (lane < 0)
+		batch->engine(batch->program, worker->context);
+	else
+		brainfuck_run(batch->program, worker->context, -1);
+	brainfuck_flush(worker->context);
+	return 0;
+}
+
+/*
+ * Runs one record and appends its output to the given chunk.
+ *
+ * @param batch The batch.
+ * @param worker The thread that runs the record.
+ * @param chunk The chunk of the record.
+ * @param record The input of the record or <code>NULL</code> if it is cut off.
+ * @param length The length of the input.
+ * @param lane The index of the lane the record is already run in or
+ *	<code>-1</code> if it is not.
+ */
+static void brainfuck_batch_one(BrainfuckBatch *batch, BrainfuckBatchWorker *worker, BrainfuckBatchChunk *chunk,
+		const char *record, size_t length, int lane) {
+	BrainfuckLane *run = lane >= 0 ? &worker->lanes->lanes[lane] : NULL;
+	size_t start = chunk->output_length;
+	size_t failed = chunk->failed;
+	unsigned char *prefix;
+	char delimiter;
+	// the length of the output is filled in once it is known
+	if (batch->delimiter == BRAINFUCK_BATCH_LENGTH &&
+			brainfuck_batch_append(&chunk->output, &chunk->output_length, &chunk->output_capacity,
+				"\0\0\0\0", 4) < 0) {
+		brainfuck_batch_error(chunk, "error: out of memory\n");
+	} else if (record == NULL) {
+		brainfuck_batch_error(chunk, "error: the record is cut off by the end of the input\n");
+	} else if (run != NULL && brainfuck_batch_append(&chunk->output, &chunk->output_length, &chunk->output_capacity,
+				run->output, run->output_length) < 0) {
+		brainfuck_batch_error(chunk, "error: out of memory\n");
+	} else if ((run == NULL || run->parked) && brainfuck_batch_record(batch, worker, record, length, lane) < 0) {
+		// output that is not flushed belongs to the failed record
+		worker->context->output_length = 0;
+	}
+	// every output ends like its record, even if the record failed, so they stay apart
+	if (batch->delimiter != BRAINFUCK_BATCH_LENGTH) {
+		delimiter = (char) batch->delimiter;
+		if (brainfuck_batch_append(&chunk->output, &chunk->output_length, &chunk->output_capacity,
+					&delimiter, 1) < 0 && chunk->failed == failed)
+			brainfuck_batch_error(chunk, "error: out of memory\n");
+	}
+	if (batch->delimiter == BRAINFUCK_BATCH_LENGTH && chunk->output_length >= start + 4) {
+		prefix = (unsigned char *) chunk->output + start;
+		length = chunk->output_length - start - 4;
+		prefix[0] = (unsigned char) (length >> 24);
+		prefix[1] = (unsigned char) (length >> 16);
+		prefix[2] = (unsigned char) (length >> 8);
+		prefix[3] = (unsigned char) length;
+	}
+	chunk->records++;
+}
+
+/*
+ * Runs the next records of the given chunk in lockstep, up to a record that is
+ * 	cut off.
+ *
+ * @param batch The batch.
+ * @param worker The thread that runs the chunk.
+ * @param chunk The chunk.
+ * @param position The position of the first record.
+ * @param finished The pointer the amount of records that finished in
+ *	lockstep is stored at.
+ * @return The position of the next record, which is the given position if
+ *	no record could be run this way.
+ */
+static const char * brainfuck_batch_lanes(BrainfuckBatch *batch, BrainfuckBatchWorker *worker,
+		BrainfuckBatchChunk *chunk, const char *position, int *finished) {
+	BrainfuckLanes *lanes = worker->lanes;
+	const char *next = position;
+	const char *following;
+	const char *record;
+	size_t length;
+	int lane;
+	for (lanes->count = 0; lanes->count < BRAINFUCK_LANES && next < chunk->end; lanes->count++) {
+		following = brainfuck_batch_next(batch->delimiter, next, chunk->end, &record, &length);
+		if (record == NULL)
+			break;
+		lanes->lanes[lanes->count].input = record;
+		lanes->lanes[lanes->count].input_length = length;
+		next = following;
+	}
+	// the lanes start at the tape index of a fresh context
+	brainfuck_restore(worker->context, worker->checkpoint);
+	if (lanes->count == 0 || brainfuck_lanes_run(lanes, batch->program, worker->context) < 0)
+		return position;
+	*finished = 0;
+	for (lane = 0; lane < lanes->count; lane++) {
+		*finished += !lanes->lanes[lane].parked;
+		brainfuck_batch_one(batch, worker, chunk, lanes->lanes[lane].input, lanes->lanes[lane].input_length, lane);
+	}
+	return next;
+}
+
+/*
+ * Runs all records of the given chunk.
+ *
+ * @param batch The batch.
+ * @param worker The thread that runs the chunk.
+ * @param chunk The chunk.
+ */
+static void brainfuck_batch_chunk(BrainfuckBatch *batch, BrainfuckBatchWorker *worker, BrainfuckBatchChunk *chunk) {
+	const char *position = chunk->begin;
+	const char *next;
+	const char *record;
+	size_t length;
+	int lockstep = worker->lanes != NULL;
+	int finished;
+	brainfuck_batch_current = chunk;
+	while (position < chunk->end) {
+		if (lockstep && (next = brainfuck_batch_lanes(batch, worker, chunk, position, &finished)) != position) {
+			position = next;
+			// records that all leave the lockstep run faster one by one for the rest of the chunk
+			lockstep = finished > 0;
+			continue;
+		}
+		position = brainfuck_batch_next(batch->delimiter, position, chunk->end, &record, &length);
+		brainfuck_batch_one(batch, worker, chunk, record, length, -1);
+	}
+}
+
+/*
+ * Takes the next chunk of records, waiting while too many chunks are not yet
+ * 	written.
+ *
+ * @param run The run.
+ * @return The chunk or <code>NULL</code> if all input is taken.
+ */
+static BrainfuckBatchChunk * brainfuck_batch_take(BrainfuckBatchRun *run) {
+	BrainfuckBatchChunk *chunk = NULL;
+	const char *record;
+	size_t length;
+	size_t count;
+	brainfuck_batch_lock(run);
+	while (!run->finished && run->taken - run->written >= run->window)
+		brainfuck_batch_wait(run);
+	if (!run->finished) {
+		chunk = &run->chunks[run->taken++ % run->window];
+		chunk->begin = run->position;
+		chunk->first = run->record;
+		for (count = 0; count < BRAINFUCK_BATCH_CHUNK && run->position < run->end; count++)
+			run->position = brainfuck_batch_next(run->batch->delimiter, run->position, run->end, &record, &length);
+		chunk->end = run->position;
+		run->record += count;
+		if (run->position == run->end) {
+			run->finished = 1;
+			brainfuck_batch_notify(run);
+		}
+	}
+	brainfuck_batch_unlock(run);
+	return chunk;
+}
+
+/*
+ * Marks the given chunk as run.
+ *
+ * @param run The run.
+ * @param chunk The chunk.
+ */
+static void brainfuck_batch_finish(BrainfuckBatchRun *run, BrainfuckBatchChunk *chunk) {
+	brainfuck_batch_lock(run);
+	chunk->done = 1;
+	brainfuck_batch_notify(run);
+	brainfuck_batch_unlock(run);
+}
+
+/*
+ * Writes the chunks that are run, in order.
+ *
+ * @param run The run.
+ * @param all Whether to wait until all chunks are written, rather than only
+ *	writing those that are run already.
+ */
+static void brainfuck_batch_drain(BrainfuckBatchRun *run, int all) {
+	BrainfuckBatch *batch = run->batch;
+	BrainfuckBatchChunk *chunk;
+	brainfuck_batch_lock(run);
+	while (1) {
+		chunk = &run->chunks[run->written % run->window];
+		if (run->written == run->taken || !chunk->done) {
+			if (!all || (run->finished && run->written == run->taken))
+				break;
+			brainfuck_batch_wait(run);
+			continue;
+		}
+		// the chunk is not reused before it is counted as written
+		brainfuck_batch_unlock(run);
+		if (batch->write_handler != NULL)
+			batch->write_handler(chunk->output, chunk->output_length);
+		else
+			fwrite(chunk->output, 1, chunk->output_length, stdout);
+		if (chunk->errors_length > 0) {
+			fflush(stdout);
+			fwrite(chunk->errors, 1, chunk->errors_length, stderr);
+		}
+		batch->records += chunk->records;
+		batch->failed += chunk->failed;
+		chunk->output_length = 0;
+		chunk->errors_length = 0;
+		chunk->records = 0;
+		chunk->failed = 0;
+		chunk->done = 0;
+		brainfuck_batch_lock(run);
+		run->written++;
+		brainfuck_batch_notify(run);
+	}
+	brainfuck_batch_unlock(run);
+	if (batch->write_handler == NULL)
+		fflush(stdout);
+}
+
+#ifdef BRAINFUCK_BATCH_THREADS
+/*
+ * Runs chunks until all input is taken.
+ *
+ * @param argument The thread.
+ * @return <code>NULL</code>.
+ */
+static void * brainfuck_batch_main(void *argument) {
+	BrainfuckBatchWorker *worker = (BrainfuckBatchWorker *) argument;
+	BrainfuckBatchChunk *chunk;
+	while ((chunk = brainfuck_batch_take(worker->run)) != NULL) {
+		brainfuck_batch_chunk(worker->run->batch, worker, chunk);
+		brainfuck_batch_finish(worker->run, chunk);
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * Runs all records on the given threads and writes their outputs from the
+ * 	current thread. If no thread can be started, the current thread runs
+ * 	the records itself.
+ *
+ * @param run The run.
+ * @param workers The threads.
+ * @param threads The amount of threads.
+ */
+static void brainfuck_batch_start(BrainfuckBatchRun *run, BrainfuckBatchWorker *workers, int threads) {
+	BrainfuckBatchChunk *chunk;
+	int started = 0;
+	int i;
+#ifdef BRAINFUCK_BATCH_THREADS
+	pthread_mutex_init(&run->lock, NULL);
+	pthread_cond_init(&run->changed, NULL);
+	for (i = 0; i < threads && threads > 1; i++) {
+		if (pthread_create(&workers[i].thread, NULL, &brainfuck_batch_main, &workers[i]) != 0)
+			break;
+		started++;
+	}
+#else
+	(void) threads;
+#endif
+	if (started > 0) {
+		brainfuck_batch_drain(run, 1);
+	} else {
+		// without threads every chunk is written as soon as it is run
+		while ((chunk = brainfuck_batch_take(run)) != NULL) {
+			brainfuck_batch_chunk(run->batch, &workers[0], chunk);
+			chunk->done = 1;
+			brainfuck_batch_drain(run, 0);
+		}
+	}
+#ifdef BRAINFUCK_BATCH_THREADS
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+	pthread_cond_destroy(&run->changed);
+	pthread_mutex_destroy(&run->lock);
+#endif
+}
+
+/*
+ * Creates a batch that runs the given program with the threaded engine on as
+ * 	many threads as there are processors, over records that end with a
+ * 	newline.
+ *
+ * @param program The program.
+ * @return The batch or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckBatch * brainfuck_batch(BrainfuckProgram *program) {
+	BrainfuckBatch *batch = malloc(sizeof(BrainfuckBatch));
+	if (batch == NULL)
+		return NULL;
+	batch->program = program;
+	batch->engine = &brainfuck_execute_program_threaded;
+	batch->context_factory = NULL;
+	batch->delimiter = '\n';
+	batch->threads = 1;
+#ifdef BRAINFUCK_BATCH_THREADS
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (processors > 1)
+		batch->threads = (int) processors;
+#endif
+	batch->write_handler = NULL;
+	batch->lanes = 0;
+	batch->records = 0;
+	batch->failed = 0;
+	return batch;
+}
+
+/*
+ * Runs the program of the given batch over every record of the given input.
+ *
+ * @param batch The batch.
+ * @param input The records.
+ * @param length The length of the input.
+ * @return <code>0</code> if all records succeeded, <code>-1</code> if any of
+ *	them failed or no context could be created.
+ */
+int brainfuck_batch_run(BrainfuckBatch *batch, const char *input, size_t length) {
+	BrainfuckBatchWorker *workers;
+	BrainfuckBatchRun run;
+	int threads;
+	int created = 0;
+	int status = -1;
+	int i;
+	if (batch == NULL || batch->program == NULL || batch->engine == NULL || (input == NULL && length > 0))
+		return -1;
+	threads = batch->threads > 1 ? batch->threads : 1;
+	batch->records = 0;
+	batch->failed = 0;
+	run.batch = batch;
+	run.position = input;
+	run.end = input + length;
+	run.window = (size_t) threads * BRAINFUCK_BATCH_WINDOW;
+	run.taken = 0;
+	run.written = 0;
+	run.record = 0;
+	run.finished = length == 0;
+	run.chunks = calloc(run.window, sizeof(BrainfuckBatchChunk));
+	workers = calloc(threads, sizeof(BrainfuckBatchWorker));
+	for (; run.chunks != NULL && workers != NULL && created < threads; created++) {
+		BrainfuckBatchWorker *worker = &workers[created];
+		worker->run = &run;
+		worker->context = batch->context_factory != NULL ? batch->context_factory() :
+			brainfuck_context(BRAINFUCK_TAPE_SIZE);
+		if (worker->context == NULL)
+			break;
+		worker->context->write_handler = &brainfuck_batch_write;
+		worker->context->error_handler = &brainfuck_batch_fail;
+		worker->checkpoint = brainfuck_checkpoint(worker->context);
+		if (worker->checkpoint == NULL) {
+			brainfuck_destroy_context(worker->context);
+			break;
+		}
+		// other cells and virtual tapes are left to the engine
+		if (batch->lanes && worker->context->cell_bits == 8 && worker->context->cell_wrap &&
+				worker->context->tape_map == NULL && worker->context->tape_size > 0)
+			worker->lanes = brainfuck_lanes((size_t) worker->context->tape_size);
+	}
+	if (created == threads) {
+		brainfuck_batch_start(&run, workers, threads);
+		status = batch->failed > 0 ? -1 : 0;
+	} else {
+		fprintf(stderr, "error: failed to create a context\n");
+	}
+	for (i = 0; i < created; i++) {
+		brainfuck_destroy_lanes(workers[i].lanes);
+		brainfuck_destroy_checkpoint(workers[i].checkpoint);
+		brainfuck_destroy_context(workers[i].context);
+	}
+	for (i = 0; run.chunks != NULL && (size_t) i < run.window; i++) {
+		free(run.chunks[i].output);
+		free(run.chunks[i].errors);
+	}
+	free(run.chunks);
+	free(workers);
+	return status;
+}
+
+/*
+ * Destroys a batch, but not its program.
+ *
+ * @param batch The batch to destroy.
+ */
+void brainfuck_destroy_batch(BrainfuckBatch *batch) {
+	free(batch);
+}
@@ -20,8 +20,72 @@
 #include <limits.h>
 #include <assert.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_MMAP 1
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
 #include "../include/brainfuck.h"
 
+/*
+ * The amount of instructions the first block of an arena holds. Every next
+ * 	block is twice as large, up to <code>BRAINFUCK_ARENA_MAX_BLOCK</code>.
+ */
+#define BRAINFUCK_ARENA_MIN_BLOCK 256
+#define BRAINFUCK_ARENA_MAX_BLOCK 65536
+
+/*
+ * The amount of nested loops the parsers and the executor make room for once
+ * 	they find a loop. Their loop stacks grow on the heap, so the nesting
+ * 	depth is only limited by the available memory and not by the C stack.
+ */
+#define BRAINFUCK_STACK_DEPTH 64
+
+/*
+ * The loops that enclose the instruction that is parsed or executed, innermost
+ * 	last.
+ */
+typedef struct BrainfuckLoopStack {
+	/*
+	 * The instructions that start the loops.
+	 */
+	BrainfuckInstruction **loops;
+	/*
+	 * The amount of loops on the stack.
+	 */
+	size_t depth;
+	/*
+	 * The amount of loops <code>loops</code> can hold.
+	 */
+	size_t capacity;
+} BrainfuckLoopStack;
+
+static BrainfuckInstruction * brainfuck_parse_stream_into(BrainfuckState *, FILE *, const int);
+static BrainfuckInstruction * brainfuck_parse_substring_into(BrainfuckState *, char *, int *, int);
+
+/*
+ * Pushes the given loop onto the given stack, growing it if necessary.
+ *
+ * @param stack The stack.
+ * @param instruction The instruction that starts the loop.
+ */
+static void brainfuck_stack_push(BrainfuckLoopStack *stack, BrainfuckInstruction *instruction) {
+	BrainfuckInstruction **grown;
+	size_t capacity;
+	if (stack->depth == stack->capacity) {
+		capacity = stack->capacity == 0 ? BRAINFUCK_STACK_DEPTH : stack->capacity * 2;
+		grown = realloc(stack->loops, sizeof(BrainfuckInstruction *) * capacity);
+		if (grown == NULL) {
+			fprintf(stderr, "error: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		stack->loops = grown;
+		stack->capacity = capacity;
+	}
+	stack->loops[stack->depth++] = instruction;
+}
+
 /*
  * Creates a new state.
  */
@@ -29,9 +93,142 @@ BrainfuckState * brainfuck_state() {
 	BrainfuckState *state = (BrainfuckState *) malloc(sizeof(BrainfuckState));
 	state->root = 0;
 	state->head = 0;
+	state->arena = 0;
+	state->cell_wrap = 1;
+	state->report_handler = 0;
 	return state;
 }
 
+/*
+ * Allocates a new instruction that is not part of a list. If a state is given,
+ * 	the instruction is allocated from its arena and is freed together with
+ * 	the state, so it must not be destroyed on its own.
+ *
+ * @param state The state to allocate the instruction from or <code>NULL</code>
+ *	to allocate it with <code>malloc</code>.
+ * @return The new instruction.
+ */
+BrainfuckInstruction * brainfuck_allocate_instruction(BrainfuckState *state) {
+	BrainfuckInstruction *instruction;
+	BrainfuckArena *block;
+	size_t capacity;
+	if (state == NULL) {
+		instruction = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
+	} else {
+		block = state->arena;
+		if (block == NULL || block->length == block->capacity) {
+			capacity = block == NULL ? BRAINFUCK_ARENA_MIN_BLOCK : block->capacity * 2;
+			if (capacity > BRAINFUCK_ARENA_MAX_BLOCK)
+				capacity = BRAINFUCK_ARENA_MAX_BLOCK;
+			block = (BrainfuckArena *) malloc(sizeof(BrainfuckArena) 
+				+ capacity * sizeof(BrainfuckInstruction));
+			if (block == NULL)
+				return NULL;
+			block->next = state->arena;
+			block->length = 0;
+			block->capacity = capacity;
+			state->arena = block;
+		}
+		instruction = &block->instructions[block->length++];
+	}
+	if (instruction == NULL)
+		return NULL;
+	instruction->next = 0;
+	instruction->previous = 0;
+	instruction->loop = 0;
+	instruction->offset = 0;
+	instruction->line = 0;
+	instruction->column = 0;
+	return instruction;
+}
+
+/*
+ * Writes the given block of output to the standard output.
+ *
+ * @param buffer The characters to write.
+ * @param length The amount of characters to write.
+ * @return The amount of characters that are written.
+ */
+static size_t brainfuck_write_stdout(const char *buffer, size_t length) {
+	return fwrite(buffer, 1, length, stdout);
+}
+
+/*
+ * Reads a line from the standard input, so that interactive programs receive
+ * 	their input as soon as a line is entered.
+ *
+ * @param buffer The buffer to read into.
+ * @param length The size of the buffer.
+ * @return The amount of characters that are read.
+ */
+static long brainfuck_read_stdin(char *buffer, size_t length) {
+	size_t count = 0;
+	int c;
+	while (count < length && (c = getchar()) != EOF) {
+		buffer[count++] = (char) c;
+		if (c == '\n')
+			break;
+	}
+	return (long) count;
+}
+
+/*
+ * Returns the handler the buffered output of the given context is written
+ * 	with. The default one is only used as long as the output handler is
+ * 	the default as well, so callers that only replace the output handler
+ * 	keep receiving every character.
+ *
+ * @param context The context.
+ * @return The write handler or <code>NULL</code> if the output handler is used.
+ */
+static BrainfuckWriteHandler brainfuck_writer(BrainfuckExecutionContext *context) {
+	if (context->write_handler == &brainfuck_write_stdout && context->output_handler != &putchar)
+		return NULL;
+	return context->write_handler;
+}
+
+/*
+ * Returns the handler the input of the given context is read ahead with. The
+ * 	default one is only used as long as the input handler is the default
+ * 	as well.
+ *
+ * @param context The context.
+ * @return The read handler or <code>NULL</code> if the input handler is used.
+ */
+static BrainfuckReadHandler brainfuck_reader(BrainfuckExecutionContext *context) {
+	if (context->read_handler == &brainfuck_read_stdin && context->input_handler != &getchar)
+		return NULL;
+	return context->read_handler;
+}
+
+/*
+ * Reports the end of the input. This is used once the input is read from
+ * 	memory, which is never refilled.
+ *
+ * @param buffer The buffer to read into.
+ * @param length The size of the buffer.
+ * @return Always <code>0</code>.
+ */
+static long brainfuck_read_none(char *buffer, size_t length) {
+	(void) buffer;
+	(void) length;
+	return 0;
+}
+
+/*
+ * Reports that no input is available yet. This is used once the input is
+ * 	supplied from memory in parts.
+ *
+ * @param buffer The buffer to read into.
+ * @param length The size of the buffer.
+ * @return Always <code>-1</code>.
+ */
+static long brainfuck_read_wait(char *buffer, size_t length) {
+	(void) buffer;
+	(void) length;
+	return -1;
+}
+
 /*
  * Creates a new brainfuck context.
  *
@@ -41,13 +238,32 @@ BrainfuckExecutionContext * brainfuck_context(int size) {
 	if (size < 0)
 		size = BRAINFUCK_TAPE_SIZE;
 		
-	char* tape = malloc(sizeof(BRAINFUCK_CELL_TYPE) * size);
+	char* tape = calloc(size, sizeof(BRAINFUCK_CELL_TYPE));
 	
 	BrainfuckExecutionContext *context = (BrainfuckExecutionContext *) 
 			malloc(sizeof(BrainfuckExecutionContext));
 	
 	context->output_handler = &putchar;
 	context->input_handler = &getchar;
+	context->write_handler = &brainfuck_write_stdout;
+	context->output_length = 0;
+	context->read_handler = &brainfuck_read_stdin;
+	context->input = context->input_buffer;
+	context->input_length = 0;
+	context->input_position = 0;
+	context->eof_behavior = BRAINFUCK_EOF_MINUS_ONE;
+	context->input_map = 0;
+	context->input_map_size = 0;
+	context->tape_map = 0;
+	context->tape_map_size = 0;
+	context->tape_map_bits = 0;
+	context->cell_bits = 8;
+	context->cell_wrap = 1;
+	context->program_counter = 0;
+	context->input_pending = 0;
+	context->error_handler = 0;
+	context->checkpoint = 0;
+	context->tape_track = 0;
 	context->tape = tape;
 	context->tape_index = 0;
 	context->tape_size = size;
@@ -211,9 +427,22 @@ BrainfuckInstruction * brainfuck_parse_stream(FILE *stream) {
  * @param The head of the linked list containing the instructions.
  */
 BrainfuckInstruction * brainfuck_parse_stream_until(FILE *stream, const int until) {
-	BrainfuckInstruction *instruction = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
-	instruction->next = 0;
-	instruction->loop = 0;
+	return brainfuck_parse_stream_into(NULL, stream, until);
+}
+
+/*
+ * Reads a character, converts it to an instruction and repeats until the given character
+ * 	occurs and will then return a linked list containing all instructions.
+ *
+ * @param state The state to allocate the instructions from or <code>NULL</code>.
+ * @param stream The stream to read from.
+ * @param until If this character is found in the stream, we will quit reading and return.
+ * @param The head of the linked list containing the instructions.
+ */
+static BrainfuckInstruction * brainfuck_parse_stream_into(BrainfuckState *state, FILE *stream,
+		const int until) {
+	BrainfuckLoopStack loops = { 0, 0, 0 };
+	BrainfuckInstruction *instruction = brainfuck_allocate_instruction(state);
 	BrainfuckInstruction *root = instruction;
 	char ch;
 	char temp;
@@ -252,19 +481,33 @@ BrainfuckInstruction * brainfuck_parse_stream_until(FILE *stream, const int unti
 			ungetc(temp, stream);
 			break;
 		case BRAINFUCK_TOKEN_LOOP_START:
-			instruction->loop = brainfuck_parse_stream_until(stream, until);
-			break;
+			brainfuck_stack_push(&loops, instruction);
+			instruction->loop = brainfuck_allocate_instruction(state);
+			instruction = instruction->loop;
+			continue;
 		case BRAINFUCK_TOKEN_LOOP_END:
-			return root;
+			if (loops.depth == 0) {
+				free(loops.loops);
+				return root;
+			}
+			// the body is terminated, continue after the loop
+			instruction = loops.loops[--loops.depth];
+			break;
 		default:
 			continue;
 		}
-		instruction->next = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
-		instruction->next->next = 0;
-		instruction->next->loop = 0;
+		instruction->next = brainfuck_allocate_instruction(state);
 		instruction = instruction->next;
 	}
+	// close the loops that are still open at the end of the stream
 	instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+	while (loops.depth > 0) {
+		instruction = loops.loops[--loops.depth];
+		instruction->next = brainfuck_allocate_instruction(state);
+		instruction = instruction->next;
+		instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+	}
+	free(loops.loops);
 	return root;
 }
 
@@ -306,15 +549,30 @@ BrainfuckInstruction * brainfuck_parse_substring(char *str, int begin, int end)
  * @param The head of the linked list containing the instructions.
  */
 BrainfuckInstruction * brainfuck_parse_substring_incremental(char *str, int *ptr, int end) {
+	return brainfuck_parse_substring_into(NULL, str, ptr, end);
+}
+
+/*
+ * Reads a character, converts it to an instruction and repeats until the string ends
+ *	and will then return a linked list containing all instructions.
+ *
+ * @param state The state to allocate the instructions from or <code>NULL</code>.
+ * @param str The string to read from.
+ * @param ptr The pointer to the integer holding the index you want to start parsing at.
+ *	Since this will be used as counter, the value of the pointer will be increased.
+ * @param end The index you want to stop parsing at.
+ *	When <code>-1</code> is given, it will stop at the end of the string.
+ * @param The head of the linked list containing the instructions.
+ */
+static BrainfuckInstruction * brainfuck_parse_substring_into(BrainfuckState *state, char *str,
+		int *ptr, int end) {
 	if (str == NULL || ptr == NULL)
 		return NULL;
 	if (end < 0)
 		end = strlen(str);
-	BrainfuckInstruction *root = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
+	BrainfuckLoopStack loops = { 0, 0, 0 };
+	BrainfuckInstruction *root = brainfuck_allocate_instruction(state);
 	BrainfuckInstruction *instruction = root;
-	instruction->next = 0;
-	instruction->previous = 0;
-	instruction->loop = 0;
 	char c, temp_c;
 	for (; *ptr < end && (c = str[*ptr]); (*ptr)++) {
 			instruction->type = c;
@@ -355,21 +613,35 @@ BrainfuckInstruction * brainfuck_parse_substring_incremental(char *str, int *ptr
 				(*ptr)--;		
 				break;
 			case BRAINFUCK_TOKEN_LOOP_START:
-				(*ptr)++;
-				instruction->loop = brainfuck_parse_substring_incremental(str, ptr, end);
-				break;
+				brainfuck_stack_push(&loops, instruction);
+				instruction->loop = brainfuck_allocate_instruction(state);
+				instruction = instruction->loop;
+				continue;
 			case BRAINFUCK_TOKEN_LOOP_END:
-				return root;
+				if (loops.depth == 0) {
+					free(loops.loops);
+					return root;
+				}
+				// the body is terminated, continue after the loop
+				instruction = loops.loops[--loops.depth];
+				break;
 			default:
 				continue;
 			}
-			instruction->next = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
-			instruction->next->next = 0;
-			instruction->next->loop = 0;
+			instruction->next = brainfuck_allocate_instruction(state);
 			instruction->next->previous = instruction;
 			instruction = instruction->next;
 		}
+		// close the loops that are still open at the end of the string
 		instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+		while (loops.depth > 0) {
+			instruction = loops.loops[--loops.depth];
+			instruction->next = brainfuck_allocate_instruction(state);
+			instruction->next->previous = instruction;
+			instruction = instruction->next;
+			instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+		}
+		free(loops.loops);
 		return root;
 }
 
@@ -383,6 +655,7 @@ BrainfuckInstruction * brainfuck_parse_character(char c) {
 	BrainfuckInstruction *instruction = (BrainfuckInstruction *) malloc(sizeof(BrainfuckInstruction));
 	instruction->next = 0;
 	instruction->loop = 0;
+	instruction->offset = 0;
 	instruction->difference = 1;
 	switch(c) {
 	case BRAINFUCK_TOKEN_PLUS:
@@ -414,29 +687,45 @@ void brainfuck_destroy_instruction(BrainfuckInstruction *instruction) {
 }
 
 /*
- * Destroys a linked list containing instructions.
+ * Destroys a linked list containing instructions. Loop bodies are rotated into
+ * 	the list before their loop instruction is destroyed, so no stack is
+ * 	needed regardless of how deeply the loops are nested.
  * 
  * @param root The start of the instruction list.
  */
 void brainfuck_destroy_instructions(BrainfuckInstruction *root) {
 	BrainfuckInstruction *tmp;
 	while (root != NULL) {
+		if (root->loop != NULL) {
+			// the body goes first and continues with the rest of its loop
+			tmp = root->loop;
+			root->loop = tmp->next;
+			tmp->next = root;
+			root = tmp;
+			continue;
+		}
 		tmp = root;
-		brainfuck_destroy_instructions(root->loop);
 		root = root->next;
 		brainfuck_destroy_instruction(tmp);
 	}
 }
 
 /*
- * Destroys a state.
+ * Destroys a state and its instructions. Instructions that are allocated from
+ * 	the arena of the state are released together with its blocks.
  * 
  * @param state The state to destroy
  */
 void brainfuck_destroy_state(BrainfuckState *state) {
+	BrainfuckArena *block;
 	if (state == NULL)
 		return;
-	brainfuck_destroy_instructions(state->root);
+	if (state->arena == NULL)
+		brainfuck_destroy_instructions(state->root);
+	while ((block = state->arena) != NULL) {
+		state->arena = block->next;
+		free(block);
+	}
 	state->head = 0;
 	state->root = 0;
 	free(state);
@@ -449,69 +738,417 @@ void brainfuck_destroy_state(BrainfuckState *state) {
  * @param context The context to destroy
  */
 void brainfuck_destroy_context(BrainfuckExecutionContext *context) {
+	if (context == NULL)
+		return;
+	brainfuck_flush(context);
+	brainfuck_checkpoint_release(context);
+#ifdef BRAINFUCK_MMAP
+	if (context->input_map != NULL)
+		munmap(context->input_map, context->input_map_size);
+	if (context->tape_map != NULL)
+		munmap(context->tape_map, context->tape_map_size);
+#endif
 	free(context);
 	context = 0;
 }
 
 /*
- * Executes the given linked list containing instructions.
+ * Reports the given error through the error handler of the given context, or
+ * 	writes it to the standard error and terminates the process if there is
+ * 	none.
+ *
+ * @param context The context of the execution.
+ * @param message The error message.
+ */
+static void brainfuck_fail(BrainfuckExecutionContext *context, const char *message) {
+	brainfuck_flush(context);
+	if (context->error_handler != NULL) {
+		brainfuck_guard_abandon();
+		context->error_handler(context, message);
+	}
+	fputs(message, stderr);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Reports that the tape index went out of bounds and terminates the program.
+ *
+ * @param context The context of the execution.
+ * @param index The tape index that is out of bounds.
+ */
+void brainfuck_out_of_bounds(BrainfuckExecutionContext *context, long index) {
+	char message[128];
+	if (index < 0)
+		snprintf(message, sizeof(message), "error: tape memory out of bounds (underrun)\nundershot the tape size of %zd cells\n", context->tape_size);
+	else
+		snprintf(message, sizeof(message), "error: tape memory out of bounds (overrun)\nexceeded the tape size of %zd cells\n", context->tape_size);
+	brainfuck_fail(context, message);
+}
+
+/*
+ * Reports that a cell left its range while cells do not wrap around and
+ * 	terminates the program.
+ *
+ * @param context The context of the execution.
+ * @param value The value the cell would have had.
+ */
+void brainfuck_overflow(BrainfuckExecutionContext *context, long long value) {
+	char message[128];
+	if (value < 0)
+		snprintf(message, sizeof(message), "error: cell underflow\n%lld does not fit in a %d-bit cell\n", value, context->cell_bits);
+	else
+		snprintf(message, sizeof(message), "error: cell overflow\n%lld does not fit in a %d-bit cell\n", value, context->cell_bits);
+	brainfuck_fail(context, message);
+}
+
+/*
+ * Writes the buffered output of the given context to its write handler.
+ *
+ * @param context The context whose output to flush.
+ */
+void brainfuck_flush(BrainfuckExecutionContext *context) {
+	BrainfuckWriteHandler writer;
+	if (context == NULL || context->output_length == 0)
+		return;
+	if ((writer = brainfuck_writer(context)) != NULL) {
+		writer(context->output_buffer, context->output_length);
+	} else {
+		size_t index;
+		for (index = 0; index < context->output_length; index++)
+			context->output_handler(context->output_buffer[index]);
+	}
+	context->output_length = 0;
+}
+
+/*
+ * Outputs the given character the given amount of times. The output is
+ * 	buffered if the context has a write handler and is otherwise passed
+ * 	to its output handler one character at a time.
+ *
+ * @param context The context of the execution.
+ * @param chr The character to output.
+ * @param count The amount of times to output the character.
+ */
+void brainfuck_output(BrainfuckExecutionContext *context, int chr, unsigned long count) {
+	size_t length;
+	if (brainfuck_writer(context) == NULL) {
+		while (count-- > 0)
+			context->output_handler((char) chr);
+		return;
+	}
+	while (count > 0) {
+		if (context->output_length == BRAINFUCK_OUTPUT_BUFFER_SIZE)
+			brainfuck_flush(context);
+		length = BRAINFUCK_OUTPUT_BUFFER_SIZE - context->output_length;
+		if (length > count)
+			length = count;
+		memset(context->output_buffer + context->output_length, chr, length);
+		context->output_length += length;
+		count -= length;
+	}
+}
+
+/*
+ * Returns the value the context asks for at the end of the input.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell.
+ * @return The value of the cell.
+ */
+static int brainfuck_input_end(BrainfuckExecutionContext *context, int current) {
+	switch (context->eof_behavior) {
+	case BRAINFUCK_EOF_ZERO:
+		return 0;
+	case BRAINFUCK_EOF_MINUS_ONE:
+		return -1;
+	default:
+		return current;
+	}
+}
+
+/*
+ * Refills the input of the given context and returns its first character, or
+ * 	the value the context asks for at the end of the input. Buffered output
+ * 	is flushed first, so that prompts are visible before the program waits
+ * 	for input.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell.
+ * @return The character that is read.
+ */
+static int brainfuck_input_refill(BrainfuckExecutionContext *context, int current) {
+	BrainfuckReadHandler reader = brainfuck_reader(context);
+	long length;
+	int chr;
+	brainfuck_flush(context);
+	if (reader == NULL) {
+		if ((chr = context->input_handler()) != EOF)
+			return chr;
+	} else if ((length = reader(context->input_buffer, BRAINFUCK_INPUT_BUFFER_SIZE)) > 0) {
+		context->input = context->input_buffer;
+		context->input_length = (size_t) length;
+		context->input_position = 1;
+		return (unsigned char) context->input[0];
+	}
+	return brainfuck_input_end(context, current);
+}
+
+/*
+ * Reads the next character of input. Only when the input that is read ahead
+ * 	is consumed is the buffered output flushed and the input refilled.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell, which is kept at the end of
+ *	the input if the context asks for it.
+ * @return The character that is read.
+ */
+int brainfuck_input(BrainfuckExecutionContext *context, int current) {
+	if (context->input_position < context->input_length)
+		return (unsigned char) context->input[context->input_position++];
+	return brainfuck_input_refill(context, current);
+}
+
+/*
+ * Reads the next character of input unless the read handler reports that no
+ * 	input is available yet.
+ *
+ * @param context The context of the execution.
+ * @param current The current value of the cell, which is kept at the end of
+ *	the input if the context asks for it.
+ * @param value The pointer the character that is read is stored at.
+ * @return <code>1</code> if a character is read, <code>0</code> if the
+ *	program has to wait for input.
+ */
+int brainfuck_input_poll(BrainfuckExecutionContext *context, int current, int *value) {
+	BrainfuckReadHandler reader = brainfuck_reader(context);
+	long length;
+	if (context->input_position < context->input_length || reader == NULL) {
+		*value = brainfuck_input(context, current);
+		return 1;
+	}
+	brainfuck_flush(context);
+	length = reader(context->input_buffer, BRAINFUCK_INPUT_BUFFER_SIZE);
+	if (length < 0)
+		return 0;
+	if (length == 0) {
+		*value = brainfuck_input_end(context, current);
+		return 1;
+	}
+	context->input = context->input_buffer;
+	context->input_length = (size_t) length;
+	context->input_position = 1;
+	*value = (unsigned char) context->input[0];
+	return 1;
+}
+
+/*
+ * Makes the given context read its input directly from the given memory,
+ * 	without copying it. The input ends at the end of the memory.
+ *
+ * @param context The context.
+ * @param input The memory to read from, which must outlive the execution.
+ * @param length The amount of characters in the memory.
+ */
+void brainfuck_set_input(BrainfuckExecutionContext *context, const char *input, size_t length) {
+	if (context == NULL)
+		return;
+	context->read_handler = &brainfuck_read_none;
+	context->input = input;
+	context->input_length = input == NULL ? 0 : length;
+	context->input_position = 0;
+}
+
+/*
+ * Makes the given context read its input directly from the given memory,
+ * 	like <code>brainfuck_set_input</code>, but once the memory is consumed
+ * 	<code>brainfuck_run</code> waits for more input instead of reaching the
+ * 	end of the input. Pass <code>NULL</code> to
+ * 	<code>brainfuck_set_input</code> to end the input.
+ *
+ * @param context The context.
+ * @param input The memory to read from, which must outlive the execution.
+ * @param length The amount of characters in the memory.
+ */
+void brainfuck_supply_input(BrainfuckExecutionContext *context, const char *input, size_t length) {
+	if (context == NULL)
+		return;
+	brainfuck_set_input(context, input, length);
+	context->read_handler = &brainfuck_read_wait;
+}
+
+/*
+ * Makes the given context read its input directly from the given file by
+ * 	mapping it into memory. The mapping is released when the context is
+ * 	destroyed.
+ *
+ * @param context The context.
+ * @param file The file to read from.
+ * @return <code>0</code> on success, <code>-1</code> if the file could not
+ *	be mapped.
+ */
+int brainfuck_map_input(BrainfuckExecutionContext *context, FILE *file) {
+#ifdef BRAINFUCK_MMAP
+	struct stat info;
+	void *map;
+	if (context == NULL || file == NULL || fstat(fileno(file), &info) < 0 || !S_ISREG(info.st_mode))
+		return -1;
+	if (info.st_size == 0) {
+		brainfuck_set_input(context, NULL, 0);
+		return 0;
+	}
+	map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED)
+		return -1;
+	if (context->input_map != NULL)
+		munmap(context->input_map, context->input_map_size);
+	context->input_map = map;
+	context->input_map_size = (size_t) info.st_size;
+	brainfuck_set_input(context, (const char *) map, (size_t) info.st_size);
+	return 0;
+#else
+	(void) context;
+	(void) file;
+	return -1;
+#endif
+}
+
+/*
+ * Returns the cell at the given offset from the current cell, terminating the
+ * 	program if it is out of bounds.
+ *
+ * @param context The context of the execution.
+ * @param offset The offset of the cell relative to the current cell.
+ * @return A pointer to the cell.
+ */
+static char * brainfuck_cell(BrainfuckExecutionContext *context, long offset) {
+	long target = context->tape_index + offset;
+	if (target < 0 || (size_t) target >= context->tape_size)
+		brainfuck_out_of_bounds(context, target);
+	return context->tape + target;
+}
+
+/*
+ * Executes the given linked list containing instructions without flushing
+ * 	the output afterwards. The loops that are entered are kept on a stack
+ * 	on the heap, so the C stack does not grow with the nesting depth.
  *
  * @param root The start of the linked list of instructions you want
  * 	to execute.
  * @param context The context of this execution that contains the tape and
  *	other execution related variables.
  */
-void brainfuck_execute(BrainfuckInstruction *root, BrainfuckExecutionContext *context) {
+static void brainfuck_execute_list(BrainfuckInstruction *root, BrainfuckExecutionContext *context) {
 	if (root == NULL || context == NULL)
 		return;
+	BrainfuckLoopStack loops = { 0, 0, 0 };
 	BrainfuckInstruction *instruction = root;
 	unsigned long index;
-	while (instruction != NULL && instruction->type != BRAINFUCK_TOKEN_LOOP_END) {
+	long target;
+	char *cell;
+	while (1) {
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			if (loops.depth == 0)
+				break;
+			// repeat the innermost loop or continue after it
+			if (context->tape[context->tape_index]) {
+				// only poll the stop flag when a loop repeats
+				if (context->shouldStop == 1)
+					break;
+				instruction = loops.loops[loops.depth - 1]->loop;
+			} else {
+				instruction = loops.loops[--loops.depth]->next;
+			}
+			continue;
+		}
 		switch (instruction->type) {
 		case BRAINFUCK_TOKEN_PLUS:
-			context->tape[context->tape_index] += (unsigned char) instruction->difference; // may overflow
+			*brainfuck_cell(context, instruction->offset) += (unsigned char) instruction->difference; // may overflow
 			break;
 		case BRAINFUCK_TOKEN_MINUS:
-			context->tape[context->tape_index] -= (unsigned char) instruction->difference; // may underflow
+			*brainfuck_cell(context, instruction->offset) -= (unsigned char) instruction->difference; // may underflow
 			break;
 		case BRAINFUCK_TOKEN_NEXT:
 			if (instruction->difference >= INT_MAX - context->tape_size || 
 					(((unsigned long)context->tape_index) + instruction->difference) >= context->tape_size) {
-				fprintf(stderr, "error: tape memory out of bounds (overrun)\nexceeded the tape size of %zd cells\n", context->tape_size);
-				exit(EXIT_FAILURE);
+				brainfuck_out_of_bounds(context, (long) context->tape_size);
 			}
 			context->tape_index += instruction->difference;
 			break;
 		case BRAINFUCK_TOKEN_PREVIOUS:
 			if (instruction->difference >= INT_MAX - context->tape_size || 
 					((long)context->tape_index) - (long)instruction->difference < 0) {
-				fprintf(stderr, "error: tape memory out of bounds (underrun)\nundershot the tape size of %zd cells\n", context->tape_size);
-				exit(EXIT_FAILURE);
+				brainfuck_out_of_bounds(context, -1);
 			}
 			context->tape_index -= instruction->difference;
 			break;
 		case BRAINFUCK_TOKEN_OUTPUT:
-			for (index = 0; index < instruction->difference; index++)
-				context->output_handler(context->tape[context->tape_index]);
+			brainfuck_output(context, *brainfuck_cell(context, instruction->offset), instruction->difference);
 			break;
 		case BRAINFUCK_TOKEN_INPUT:
+			cell = brainfuck_cell(context, instruction->offset);
 			for (index = 0; index < instruction->difference; index++)
-				context->tape[context->tape_index] = context->input_handler();
+				*cell = brainfuck_input(context, *cell);
 			break;
 		case BRAINFUCK_TOKEN_LOOP_START:
-			while(context->tape[context->tape_index])
-				brainfuck_execute(instruction->loop, context);
+			if (context->tape[context->tape_index]) {
+				brainfuck_stack_push(&loops, instruction);
+				instruction = instruction->loop;
+				continue;
+			}
+			break;
+		case BRAINFUCK_INSTRUCTION_SET:
+			*brainfuck_cell(context, instruction->offset) = (char) instruction->difference;
+			break;
+		case BRAINFUCK_INSTRUCTION_MUL:
+			// the loop this is derived from would not have moved on a zero cell
+			if (!context->tape[context->tape_index])
+				break;
+			*brainfuck_cell(context, instruction->offset) += (unsigned char) ((unsigned char) 
+					context->tape[context->tape_index] * instruction->difference); // may overflow
+			break;
+		case BRAINFUCK_INSTRUCTION_SCAN:
+			target = brainfuck_scan(context->tape, context->tape_size, context->tape_index,
+					(long) instruction->difference);
+			if (target < 0 || (size_t) target >= context->tape_size)
+				brainfuck_out_of_bounds(context, target);
+			context->tape_index = target;
 			break;
 		default:
-			return;
+			// ends the list it is part of
+			instruction = NULL;
+			continue;
 		}
 		instruction = instruction->next;
+	}
+	free(loops.loops);
+}
 
-		if (context->shouldStop == 1) {
-			instruction = NULL;
-			return;
+/*
+ * Executes the given linked list containing instructions. Cells that are wider
+ * 	than 8 bits or do not wrap around are only supported by the compiled
+ * 	engines, so in that case the instructions are compiled first.
+ *
+ * @param root The start of the linked list of instructions you want
+ * 	to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute(BrainfuckInstruction *root, BrainfuckExecutionContext *context) {
+	BrainfuckProgram *program;
+	if (root == NULL || context == NULL)
+		return;
+	if (context->cell_bits != 8 || !context->cell_wrap) {
+		program = brainfuck_compile(root);
+		if (program == NULL) {
+			fprintf(stderr, "error: out of memory\n");
+			exit(EXIT_FAILURE);
 		}
-	} 
+		brainfuck_execute_program(program, context);
+		brainfuck_destroy_program(program);
+		return;
+	}
+	brainfuck_execute_list(root, context);
+	brainfuck_flush(context);
 }
 
 /*
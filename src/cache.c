@@ -0,0 +1,283 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_CACHE_POSIX 1
+#	include <unistd.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#include "../include/brainfuck.h"
+
+/*
+ * The bytes every cache entry starts with.
+ */
+#define BRAINFUCK_CACHE_MAGIC "BFCACHE"
+
+/*
+ * The value that is stored to detect entries written on a machine with a
+ * 	different byte order.
+ */
+#define BRAINFUCK_CACHE_BYTE_ORDER 0x01020304u
+
+/*
+ * The header of a cache entry, which is followed by the operations of the
+ * 	program. Entries are only read on the machine that writes them, so
+ * 	the header and the operations are stored in native byte order.
+ */
+typedef struct BrainfuckCacheHeader {
+	/*
+	 * <code>BRAINFUCK_CACHE_MAGIC</code>, including its terminator.
+	 */
+	char magic[8];
+	/*
+	 * <code>BRAINFUCK_CACHE_VERSION</code>.
+	 */
+	uint32_t version;
+	/*
+	 * <code>BRAINFUCK_CACHE_BYTE_ORDER</code>.
+	 */
+	uint32_t byte_order;
+	/*
+	 * The size of an operation in bytes.
+	 */
+	uint32_t operation_size;
+	uint32_t reserved;
+	/*
+	 * The key the program is cached under.
+	 */
+	uint64_t key;
+	/*
+	 * The amount of operations that follow the header.
+	 */
+	uint64_t length;
+} BrainfuckCacheHeader;
+
+/*
+ * Adds the given bytes to a 64-bit FNV-1a hash.
+ *
+ * @param hash The hash so far.
+ * @param data The bytes to add.
+ * @param length The amount of bytes.
+ * @return The new hash.
+ */
+static uint64_t brainfuck_cache_hash(uint64_t hash, const void *data, size_t length) {
+	const unsigned char *bytes = (const unsigned char *) data;
+	size_t index;
+	for (index = 0; index < length; index++) {
+		hash ^= bytes[index];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Computes the key a compiled program is cached under from its source, the
+ * 	optimizations it is compiled with and the version of this library and
+ * 	of the cache format, and the cells it is compiled for, since loops
+ * 	are only rewritten if their cells wrap and programs that are
+ * 	evaluated at compile time depend on the width of the cells.
+ *
+ * @param source The source of the program.
+ * @param length The length of the source.
+ * @param level The optimization level.
+ * @param bits The width of the cells in bits.
+ * @param wrap Whether the cells wrap around.
+ * @return The key.
+ */
+unsigned long long brainfuck_cache_key(const char *source, size_t length, int level, int bits, int wrap) {
+	const uint32_t version = BRAINFUCK_CACHE_VERSION;
+	const uint64_t size = length;
+	uint64_t hash = 14695981039346656037ULL;
+	hash = brainfuck_cache_hash(hash, BRAINFUCK_VERSION, sizeof(BRAINFUCK_VERSION));
+	hash = brainfuck_cache_hash(hash, &version, sizeof(version));
+	hash = brainfuck_cache_hash(hash, &level, sizeof(level));
+	hash = brainfuck_cache_hash(hash, &bits, sizeof(bits));
+	hash = brainfuck_cache_hash(hash, &wrap, sizeof(wrap));
+	hash = brainfuck_cache_hash(hash, &size, sizeof(size));
+	if (source != NULL)
+		hash = brainfuck_cache_hash(hash, source, length);
+	return hash;
+}
+
+/*
+ * Writes the path of the entry with the given key into the given buffer.
+ *
+ * @param buffer The buffer.
+ * @param size The size of the buffer.
+ * @param directory The cache directory.
+ * @param key The key of the entry.
+ * @return <code>0</code> on success, <code>-1</code> if the path is too long.
+ */
+static int brainfuck_cache_path(char *buffer, size_t size, const char *directory, unsigned long long key) {
+	int length = snprintf(buffer, size, "%s/%016llx.bfc", directory, key);
+	return length < 0 || (size_t) length >= size ? -1 : 0;
+}
+
+/*
+ * Checks the header of a cache entry of the given size.
+ *
+ * @param header The header.
+ * @param size The size of the entry in bytes.
+ * @param key The key the entry must have.
+ * @return <code>0</code> if the header is valid, <code>-1</code> otherwise.
+ */
+static int brainfuck_cache_check(const BrainfuckCacheHeader *header, size_t size, unsigned long long key) {
+	if (memcmp(header->magic, BRAINFUCK_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+			header->version != BRAINFUCK_CACHE_VERSION ||
+			header->byte_order != BRAINFUCK_CACHE_BYTE_ORDER ||
+			header->operation_size != sizeof(BrainfuckOperation) ||
+			header->key != key || header->length == 0 ||
+			header->length > (size - sizeof(BrainfuckCacheHeader)) / sizeof(BrainfuckOperation) ||
+			size != sizeof(BrainfuckCacheHeader) + header->length * sizeof(BrainfuckOperation))
+		return -1;
+	return 0;
+}
+
+/*
+ * Loads the compiled program that is cached under the given key in the given
+ * 	directory. The entry is mapped into memory where possible, so loading
+ * 	costs a single pass over the operations to validate them.
+ *
+ * @param directory The cache directory.
+ * @param key The key of the program.
+ * @return The program or <code>NULL</code> if there is no valid entry.
+ */
+BrainfuckProgram * brainfuck_cache_load(const char *directory, unsigned long long key) {
+	BrainfuckProgram *program;
+	BrainfuckCacheHeader header;
+	char path[4096];
+	FILE *stream;
+	long size;
+	if (directory == NULL || brainfuck_cache_path(path, sizeof(path), directory, key) < 0)
+		return NULL;
+	program = (BrainfuckProgram *) malloc(sizeof(BrainfuckProgram));
+	if (program == NULL)
+		return NULL;
+	program->map = 0;
+	program->map_size = 0;
+	program->operations = 0;
+	program->positions = 0;
+	program->threaded = 0;
+#ifdef BRAINFUCK_CACHE_POSIX
+	struct stat info;
+	void *map;
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0) {
+		free(program);
+		return NULL;
+	}
+	if (fstat(descriptor, &info) == 0 && (size_t) info.st_size > sizeof(BrainfuckCacheHeader)) {
+		map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (map != MAP_FAILED) {
+			program->map = map;
+			program->map_size = (size_t) info.st_size;
+		}
+	}
+	close(descriptor);
+	if (program->map != NULL) {
+		memcpy(&header, program->map, sizeof(header));
+		program->operations = (BrainfuckOperation *) ((char *) program->map + sizeof(header));
+		program->length = (size_t) header.length;
+		if (brainfuck_cache_check(&header, program->map_size, key) == 0 &&
+				brainfuck_validate_program(program) == 0)
+			return program;
+		brainfuck_destroy_program(program);
+		return NULL;
+	}
+#endif
+	stream = fopen(path, "rb");
+	if (stream == NULL) {
+		free(program);
+		return NULL;
+	}
+	if (fseek(stream, 0, SEEK_END) != 0 || (size = ftell(stream)) < (long) sizeof(header) ||
+			fseek(stream, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, stream) != 1 ||
+			brainfuck_cache_check(&header, (size_t) size, key) < 0 ||
+			(program->operations = malloc(sizeof(BrainfuckOperation) * header.length)) == NULL ||
+			fread(program->operations, sizeof(BrainfuckOperation), header.length, stream) != header.length) {
+		fclose(stream);
+		brainfuck_destroy_program(program);
+		return NULL;
+	}
+	fclose(stream);
+	program->length = (size_t) header.length;
+	if (brainfuck_validate_program(program) < 0) {
+		brainfuck_destroy_program(program);
+		return NULL;
+	}
+	return program;
+}
+
+/*
+ * Stores the given compiled program in the given directory under the given
+ * 	key. The entry is written to a temporary file first and then renamed,
+ * 	so concurrent readers never see a partial entry.
+ *
+ * @param directory The cache directory, which is created if it does not exist.
+ * @param key The key of the program.
+ * @param program The program to store.
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+int brainfuck_cache_store(const char *directory, unsigned long long key, BrainfuckProgram *program) {
+	BrainfuckCacheHeader header;
+	char path[4096];
+	char temporary[4096 + 16];
+	FILE *stream;
+	int failed;
+	if (directory == NULL || program == NULL ||
+			brainfuck_cache_path(path, sizeof(path), directory, key) < 0)
+		return -1;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BRAINFUCK_CACHE_MAGIC, sizeof(header.magic));
+	header.version = BRAINFUCK_CACHE_VERSION;
+	header.byte_order = BRAINFUCK_CACHE_BYTE_ORDER;
+	header.operation_size = sizeof(BrainfuckOperation);
+	header.key = key;
+	header.length = program->length;
+#ifdef BRAINFUCK_CACHE_POSIX
+	int descriptor;
+	mkdir(directory, 0777);
+	snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path);
+	if ((descriptor = mkstemp(temporary)) < 0)
+		return -1;
+	stream = fdopen(descriptor, "wb");
+	if (stream == NULL) {
+		close(descriptor);
+		unlink(temporary);
+		return -1;
+	}
+#else
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	if ((stream = fopen(temporary, "wb")) == NULL)
+		return -1;
+#endif
+	failed = fwrite(&header, sizeof(header), 1, stream) != 1 ||
+		fwrite(program->operations, sizeof(BrainfuckOperation), program->length, stream) != program->length;
+	failed |= fclose(stream) != 0;
+	if (failed || rename(temporary, path) != 0) {
+		remove(temporary);
+		return -1;
+	}
+	return 0;
+}
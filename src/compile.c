@@ -0,0 +1,1141 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_COMPILE_MMAP 1
+#	include <sys/mman.h>
+#endif
+
+#include "../include/brainfuck.h"
+
+/*
+ * The amount of operations a program is able to hold initially.
+ */
+#define BRAINFUCK_PROGRAM_CAPACITY 64
+
+/*
+ * The amount of nested loops the compiler makes room for once it finds a loop.
+ */
+#define BRAINFUCK_COMPILE_DEPTH 64
+
+/*
+ * Appends an operation to the given program, growing the operation array
+ * 	when it is full.
+ *
+ * @param program The program to append the operation to.
+ * @param capacity The pointer to the capacity of the operation array.
+ * @param opcode The opcode of the operation.
+ * @param argument The operand of the operation.
+ * @param offset The offset of the cell the operation operates on.
+ * @return <code>0</code> on success, <code>-1</code> if the operation array
+ *	could not be grown.
+ */
+static int brainfuck_compile_emit(BrainfuckProgram *program, size_t *capacity,
+		int opcode, int argument, int offset) {
+	BrainfuckOperation *operations;
+	BrainfuckPosition *positions;
+	if (program->length == *capacity) {
+		operations = realloc(program->operations,
+				sizeof(BrainfuckOperation) * *capacity * 2);
+		if (operations == NULL)
+			return -1;
+		program->operations = operations;
+		if (program->positions != NULL) {
+			positions = realloc(program->positions, sizeof(BrainfuckPosition) * *capacity * 2);
+			if (positions == NULL)
+				return -1;
+			program->positions = positions;
+		}
+		*capacity *= 2;
+	}
+	program->operations[program->length].opcode = opcode;
+	program->operations[program->length].argument = argument;
+	program->operations[program->length].offset = offset;
+	program->length++;
+	return 0;
+}
+
+/*
+ * Appends an operation with an operand that may not fit in an <code>int</code>,
+ * 	splitting it into multiple operations if necessary.
+ *
+ * @param program The program to append the operations to.
+ * @param capacity The pointer to the capacity of the operation array.
+ * @param opcode The opcode of the operations.
+ * @param amount The total operand of the operations.
+ * @param offset The offset of the cell the operations operate on.
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+static int brainfuck_compile_emit_amount(BrainfuckProgram *program, size_t *capacity,
+		int opcode, long amount, int offset) {
+	int argument;
+	while (amount != 0) {
+		if (amount > INT_MAX)
+			argument = INT_MAX;
+		else if (amount < -INT_MAX)
+			argument = -INT_MAX;
+		else
+			argument = (int) amount;
+		if (brainfuck_compile_emit(program, capacity, opcode, argument, offset) < 0)
+			return -1;
+		amount -= argument;
+	}
+	return 0;
+}
+
+/*
+ * Records the position of the given instruction for the operations that are
+ * 	appended to the given program since the given index, if the program
+ * 	keeps positions.
+ *
+ * @param program The program.
+ * @param start The index of the first operation of the instruction.
+ * @param instruction The instruction the operations are compiled from.
+ */
+static void brainfuck_compile_locate(BrainfuckProgram *program, size_t start,
+		const BrainfuckInstruction *instruction) {
+	if (program->positions == NULL)
+		return;
+	for (; start < program->length; start++) {
+		program->positions[start].line = instruction != NULL ? instruction->line : 0;
+		program->positions[start].column = instruction != NULL ? instruction->column : 0;
+	}
+}
+
+/*
+ * A loop whose body is being compiled.
+ */
+typedef struct BrainfuckCompileLoop {
+	/*
+	 * The instruction that starts the loop.
+	 */
+	BrainfuckInstruction *instruction;
+	/*
+	 * The index of the operation that jumps past the loop.
+	 */
+	size_t start;
+} BrainfuckCompileLoop;
+
+/*
+ * Compiles the given linked list containing instructions and appends the
+ * 	operations to the given program. Loops that are entered are kept on a
+ * 	stack on the heap, so the C stack does not grow with the nesting depth.
+ *
+ * @param program The program to append the operations to.
+ * @param capacity The pointer to the capacity of the operation array.
+ * @param instruction The start of the linked list of instructions.
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+static int brainfuck_compile_list(BrainfuckProgram *program, size_t *capacity,
+		BrainfuckInstruction *instruction) {
+	BrainfuckCompileLoop *loops = NULL;
+	BrainfuckCompileLoop *grown;
+	size_t depth = 0;
+	size_t allocated = 0;
+	size_t start;
+	size_t first;
+	int result = 0;
+	/*
+	 * Runs of mixed tokens (e.g. "+-" or "<>") wrap the unsigned difference
+	 * 	around, so reinterpreting it as a signed value yields the net amount.
+	 */
+	while (result == 0) {
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			if (depth == 0)
+				break;
+			// close the innermost loop and continue after it
+			start = loops[--depth].start;
+			if (program->length - start > INT_MAX ||
+					brainfuck_compile_emit(program, capacity, BRAINFUCK_OP_JUMP_NONZERO,
+						(int) (program->length - start), 0) < 0) {
+				result = -1;
+				break;
+			}
+			// the closing jump belongs to the ']' that terminates the body
+			brainfuck_compile_locate(program, program->length - 1,
+					instruction != NULL ? instruction : loops[depth].instruction);
+			program->operations[start].argument = (int) (program->length - 1 - start);
+			instruction = loops[depth].instruction->next;
+			continue;
+		}
+		if (instruction->offset > INT_MAX || instruction->offset < -INT_MAX) {
+			result = -1;
+			break;
+		}
+		first = program->length;
+		switch (instruction->type) {
+		case BRAINFUCK_TOKEN_PLUS:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_ADD,
+					(long) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_TOKEN_MINUS:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_ADD,
+					-(long) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_TOKEN_NEXT:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_MOVE,
+					(long) instruction->difference, 0);
+			break;
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_MOVE,
+					-(long) instruction->difference, 0);
+			break;
+		case BRAINFUCK_TOKEN_OUTPUT:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_OUTPUT,
+					(long) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_TOKEN_INPUT:
+			result = brainfuck_compile_emit_amount(program, capacity, BRAINFUCK_OP_INPUT,
+					(long) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_INSTRUCTION_SET:
+			result = brainfuck_compile_emit(program, capacity, BRAINFUCK_OP_SET,
+					(int) (unsigned int) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_INSTRUCTION_MUL:
+			result = brainfuck_compile_emit(program, capacity, BRAINFUCK_OP_MUL,
+					(int) (unsigned int) instruction->difference, (int) instruction->offset);
+			break;
+		case BRAINFUCK_INSTRUCTION_SCAN:
+			if ((long) instruction->difference > INT_MAX || (long) instruction->difference < -INT_MAX) {
+				result = -1;
+				break;
+			}
+			result = brainfuck_compile_emit(program, capacity, BRAINFUCK_OP_SCAN,
+					(int) (long) instruction->difference, 0);
+			break;
+		case BRAINFUCK_TOKEN_LOOP_START:
+			if (depth == allocated) {
+				allocated = allocated == 0 ? BRAINFUCK_COMPILE_DEPTH : allocated * 2;
+				grown = realloc(loops, sizeof(BrainfuckCompileLoop) * allocated);
+				if (grown == NULL) {
+					result = -1;
+					break;
+				}
+				loops = grown;
+			}
+			loops[depth].instruction = instruction;
+			loops[depth++].start = program->length;
+			result = brainfuck_compile_emit(program, capacity, BRAINFUCK_OP_JUMP_ZERO, 0, 0);
+			brainfuck_compile_locate(program, program->length - 1, instruction);
+			instruction = instruction->loop;
+			continue;
+		default:
+			// ends the list it is part of
+			instruction = NULL;
+			continue;
+		}
+		brainfuck_compile_locate(program, first, instruction);
+		instruction = instruction->next;
+	}
+	free(loops);
+	return result;
+}
+
+/*
+ * Computes the largest distance past the last accessed cell that the given
+ * 	program may access: the longest run of moves without an access in
+ * 	between, plus the largest offset.
+ *
+ * @param program The program.
+ * @return The distance in cells.
+ */
+static size_t brainfuck_compile_reach(BrainfuckProgram *program) {
+	size_t run = 0;
+	size_t moves = 0;
+	size_t offsets = 0;
+	size_t n;
+	const BrainfuckOperation *operation;
+	for (n = 0; n < program->length; n++) {
+		operation = &program->operations[n];
+		if (operation->opcode == BRAINFUCK_OP_MOVE) {
+			run += (size_t) labs(operation->argument);
+			if (run > moves)
+				moves = run;
+		} else {
+			run = 0;
+			if ((size_t) labs(operation->offset) > offsets)
+				offsets = (size_t) labs(operation->offset);
+		}
+	}
+	return moves + offsets;
+}
+
+/*
+ * Compiles the given linked list containing instructions into a flat array of
+ * 	operations with resolved jump targets.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @param positions Whether the source position of every operation is recorded.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+static BrainfuckProgram * brainfuck_compile_program(BrainfuckInstruction *root, int positions) {
+	size_t capacity = BRAINFUCK_PROGRAM_CAPACITY;
+	BrainfuckProgram *program = (BrainfuckProgram *) malloc(sizeof(BrainfuckProgram));
+	if (program == NULL)
+		return NULL;
+	program->length = 0;
+	program->map = 0;
+	program->map_size = 0;
+	program->positions = 0;
+	program->threaded = 0;
+	program->operations = malloc(sizeof(BrainfuckOperation) * capacity);
+	if (positions && program->operations != NULL)
+		program->positions = malloc(sizeof(BrainfuckPosition) * capacity);
+	if (program->operations == NULL || (positions && program->positions == NULL) ||
+			brainfuck_compile_list(program, &capacity, root) < 0 ||
+			brainfuck_compile_emit(program, &capacity, BRAINFUCK_OP_END, 0, 0) < 0) {
+		brainfuck_destroy_program(program);
+		return NULL;
+	}
+	brainfuck_compile_locate(program, program->length - 1, NULL);
+	program->reach = brainfuck_compile_reach(program);
+	return program;
+}
+
+/*
+ * Compiles the given linked list containing instructions into a flat array of
+ * 	operations with resolved jump targets.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckProgram * brainfuck_compile(BrainfuckInstruction *root) {
+	return brainfuck_compile_program(root, 0);
+}
+
+/*
+ * Compiles the given linked list containing instructions like
+ * 	<code>brainfuck_compile</code> and records the source position of every
+ * 	operation, so that profiles can be traced back to the source.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckProgram * brainfuck_compile_with_positions(BrainfuckInstruction *root) {
+	return brainfuck_compile_program(root, 1);
+}
+
+/*
+ * Executes the given compiled program using the fastest engine available.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	brainfuck_execute_program_threaded(program, context);
+}
+
+/*
+ * Terminates the program if the given tape index is out of bounds. Expects the
+ * 	size of the tape in a local named <code>size</code>, since every write
+ * 	through the tape would otherwise force it to be reloaded.
+ *
+ * @param context The context of the execution.
+ * @param index The tape index to check.
+ */
+#define BRAINFUCK_CHECK_INDEX(context, index) \
+	if ((unsigned long) (index) >= size) \
+		brainfuck_out_of_bounds(context, index)
+
+#ifdef BRAINFUCK_THREADED_DISPATCH
+/*
+ * An operation of a compiled program that is translated for direct-threaded
+ * 	dispatch, in which the opcode is replaced by the address of its handler.
+ */
+typedef struct BrainfuckThreadedOperation {
+	/*
+	 * The address of the handler of this operation.
+	 */
+	const void *handler;
+	/*
+	 * The operand of this operation.
+	 */
+	int argument;
+	/*
+	 * The offset of the cell this operation operates on.
+	 */
+	int offset;
+} BrainfuckThreadedOperation;
+
+/*
+ * The operations of a compiled program translated for one direct-threaded
+ * 	engine. The translations of a program form a list that only grows
+ * 	until the program is destroyed, so engines that run on other threads
+ * 	or leave through the error handler never free them.
+ */
+typedef struct BrainfuckThreadedCode {
+	/*
+	 * The handlers of the engine the operations are translated for.
+	 */
+	const void * const *handlers;
+	/*
+	 * The translation for another engine or <code>NULL</code>.
+	 */
+	struct BrainfuckThreadedCode *next;
+	/*
+	 * The translated operations.
+	 */
+	BrainfuckThreadedOperation operations[];
+} BrainfuckThreadedCode;
+
+/*
+ * Returns the operations of the given program translated for the engine with
+ * 	the given handlers, translating them on the first run of that engine.
+ *
+ * @param program The program.
+ * @param handlers The handlers of the engine, indexed by opcode up to
+ *	<code>BRAINFUCK_OP_END</code>.
+ * @return The translated operations or <code>NULL</code> if they could not be
+ *	allocated.
+ */
+static const BrainfuckThreadedOperation * brainfuck_compile_threaded(BrainfuckProgram *program,
+		const void * const *handlers) {
+	BrainfuckThreadedCode *head = (BrainfuckThreadedCode *) program->threaded;
+	BrainfuckThreadedCode *code;
+	size_t n;
+	for (code = head; code != NULL; code = code->next) {
+		if (code->handlers == handlers)
+			return code->operations;
+	}
+	code = malloc(sizeof(BrainfuckThreadedCode) + sizeof(BrainfuckThreadedOperation) * program->length);
+	if (code == NULL)
+		return NULL;
+	code->handlers = handlers;
+	for (n = 0; n < program->length; n++) {
+		code->operations[n].handler = handlers[program->operations[n].opcode <= BRAINFUCK_OP_END ?
+			program->operations[n].opcode : BRAINFUCK_OP_END];
+		code->operations[n].argument = program->operations[n].argument;
+		code->operations[n].offset = program->operations[n].offset;
+	}
+	// threads that translate the program at the same time each add their own
+	do {
+		code->next = head;
+	} while ((head = __sync_val_compare_and_swap((BrainfuckThreadedCode **) &program->threaded,
+			code->next, code)) != code->next);
+	return code->operations;
+}
+#endif
+
+/*
+ * Finds the next zero cell on a tape of 16-bit cells, starting at the given
+ * 	index and moving by the given stride.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or, if the scan runs off the tape, the
+ *	first index that is out of bounds.
+ */
+static long brainfuck_compile_scan16(const uint16_t *tape, size_t size, long index, long stride) {
+	while ((unsigned long) index < size && tape[index] != 0)
+		index += stride;
+	return index;
+}
+
+/*
+ * Finds the next zero cell on a tape of 32-bit cells, starting at the given
+ * 	index and moving by the given stride.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or, if the scan runs off the tape, the
+ *	first index that is out of bounds.
+ */
+static long brainfuck_compile_scan32(const uint32_t *tape, size_t size, long index, long stride) {
+	while ((unsigned long) index < size && tape[index] != 0)
+		index += stride;
+	return index;
+}
+
+/*
+ * The engines for every cell width, with and without wrapping cells, that
+ * 	either check every tape index or rely on the guard pages around the
+ * 	tape to detect accesses that are out of bounds.
+ */
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 0
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 8
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 16
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 1
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+#define BRAINFUCK_ENGINE_BITS 32
+#define BRAINFUCK_ENGINE_WRAP 0
+#define BRAINFUCK_ENGINE_CHECKED 1
+#define BRAINFUCK_ENGINE_PROFILE 1
+#include "engine.h"
+
+/*
+ * The <code>switch</code> engines, indexed by the cell width (8, 16 and 32
+ * 	bits), whether cells wrap around and whether indices are checked.
+ */
+static const BrainfuckProgramEngine brainfuck_compile_switch_engines[3][2][2] = {
+	{
+		{ &brainfuck_engine_switch_8_0_0, &brainfuck_engine_switch_8_0_1 },
+		{ &brainfuck_engine_switch_8_1_0, &brainfuck_engine_switch_8_1_1 }
+	}, {
+		{ &brainfuck_engine_switch_16_0_0, &brainfuck_engine_switch_16_0_1 },
+		{ &brainfuck_engine_switch_16_1_0, &brainfuck_engine_switch_16_1_1 }
+	}, {
+		{ &brainfuck_engine_switch_32_0_0, &brainfuck_engine_switch_32_0_1 },
+		{ &brainfuck_engine_switch_32_1_0, &brainfuck_engine_switch_32_1_1 }
+	}
+};
+
+/*
+ * The resumable engines, indexed by the cell width and whether cells wrap
+ * 	around.
+ */
+static BrainfuckStatus (* const brainfuck_compile_run_engines[3][2])(BrainfuckProgram *,
+		BrainfuckExecutionContext *, long) = {
+	{ &brainfuck_engine_run_8_0_1, &brainfuck_engine_run_8_1_1 },
+	{ &brainfuck_engine_run_16_0_1, &brainfuck_engine_run_16_1_1 },
+	{ &brainfuck_engine_run_32_0_1, &brainfuck_engine_run_32_1_1 }
+};
+
+/*
+ * The profiling engines, indexed by the cell width and whether cells wrap
+ * 	around.
+ */
+static void (* const brainfuck_compile_profile_engines[3][2])(BrainfuckProgram *,
+		BrainfuckExecutionContext *, unsigned long long *) = {
+	{ &brainfuck_engine_profile_8_0_1, &brainfuck_engine_profile_8_1_1 },
+	{ &brainfuck_engine_profile_16_0_1, &brainfuck_engine_profile_16_1_1 },
+	{ &brainfuck_engine_profile_32_0_1, &brainfuck_engine_profile_32_1_1 }
+};
+
+#ifdef BRAINFUCK_THREADED_DISPATCH
+/*
+ * The direct-threaded engines, indexed like the <code>switch</code> engines.
+ */
+static const BrainfuckProgramEngine brainfuck_compile_threaded_engines[3][2][2] = {
+	{
+		{ &brainfuck_engine_threaded_8_0_0, &brainfuck_engine_threaded_8_0_1 },
+		{ &brainfuck_engine_threaded_8_1_0, &brainfuck_engine_threaded_8_1_1 }
+	}, {
+		{ &brainfuck_engine_threaded_16_0_0, &brainfuck_engine_threaded_16_0_1 },
+		{ &brainfuck_engine_threaded_16_1_0, &brainfuck_engine_threaded_16_1_1 }
+	}, {
+		{ &brainfuck_engine_threaded_32_0_0, &brainfuck_engine_threaded_32_0_1 },
+		{ &brainfuck_engine_threaded_32_1_0, &brainfuck_engine_threaded_32_1_1 }
+	}
+};
+#endif
+
+/*
+ * Determines whether the given program can run without bounds checks on the
+ * 	tape of the given context, which is the case if the tape is guarded and
+ * 	no operation reaches past the guard pages.
+ *
+ * @param program The program.
+ * @param context The context of the execution.
+ * @return <code>1</code> if the checks can be left out, <code>0</code> otherwise.
+ */
+static int brainfuck_compile_is_guarded(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	return context->tape_map != NULL &&
+		program->reach * (size_t) (context->cell_bits / 8) < BRAINFUCK_TAPE_GUARD_SIZE;
+}
+
+/*
+ * Runs the given compiled program with the engine from the given table that
+ * 	matches the cells of the given context.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution.
+ * @param engines The engines to choose from.
+ */
+static void brainfuck_compile_run(BrainfuckProgram *program, BrainfuckExecutionContext *context,
+		const BrainfuckProgramEngine engines[3][2][2]) {
+	const int width = context->cell_bits == 32 ? 2 : context->cell_bits == 16 ? 1 : 0;
+	const int wrap = context->cell_wrap != 0;
+	brainfuck_guard_fit(context);
+	if (brainfuck_compile_is_guarded(program, context))
+		brainfuck_guard_run(program, context, engines[width][wrap][0]);
+	else
+		engines[width][wrap][1](program, context);
+}
+
+/*
+ * Executes the given compiled program using a portable <code>switch</code>
+ * 	dispatch loop.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program_switch(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	if (program == NULL || context == NULL)
+		return;
+	brainfuck_compile_run(program, context, brainfuck_compile_switch_engines);
+}
+
+/*
+ * Executes the given compiled program using direct-threaded dispatch. If this
+ * 	compiler does not support labels as values, the portable
+ * 	<code>switch</code> engine is used instead.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_execute_program_threaded(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+#ifdef BRAINFUCK_THREADED_DISPATCH
+	if (program == NULL || context == NULL)
+		return;
+	brainfuck_compile_run(program, context, brainfuck_compile_threaded_engines);
+#else
+	brainfuck_execute_program_switch(program, context);
+#endif
+}
+
+/*
+ * Executes the given compiled program from where the previous call stopped
+ * 	until it ends, the given fuel is used up or it waits for input. The
+ * 	budget is only checked when a loop repeats, where every iteration costs
+ * 	the length of its body, so straight-line code runs without any checks.
+ * 	The position in the program is kept in the context, which must not be
+ * 	used for another program until this one has finished.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ * @param fuel The amount of operations that may be executed or a negative
+ *	value for no limit.
+ * @return The reason execution stopped.
+ */
+BrainfuckStatus brainfuck_run(BrainfuckProgram *program, BrainfuckExecutionContext *context, long fuel) {
+	int width;
+	if (program == NULL || context == NULL)
+		return BRAINFUCK_STATUS_FINISHED;
+	width = context->cell_bits == 32 ? 2 : context->cell_bits == 16 ? 1 : 0;
+	if (fuel < 0)
+		fuel = LONG_MAX;
+	brainfuck_guard_fit(context);
+	return brainfuck_compile_run_engines[width][context->cell_wrap != 0](program, context, fuel);
+}
+
+/*
+ * Executes the given compiled program with a variant of the <code>switch</code>
+ * 	engine that counts how often every operation is executed. The other
+ * 	engines do not count anything, so they run at full speed. Every index
+ * 	is checked, so the guard pages of a virtual tape are not relied upon.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ * @return The amount of executions of every operation, indexed like the
+ *	operations of the program, or <code>NULL</code> if it could not be
+ *	allocated. It must be freed with <code>free</code>.
+ */
+unsigned long long * brainfuck_profile_program(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	unsigned long long *counts;
+	int width;
+	if (program == NULL || context == NULL)
+		return NULL;
+	counts = calloc(program->length, sizeof(unsigned long long));
+	if (counts == NULL)
+		return NULL;
+	width = context->cell_bits == 32 ? 2 : context->cell_bits == 16 ? 1 : 0;
+	brainfuck_guard_fit(context);
+	brainfuck_compile_profile_engines[width][context->cell_wrap != 0](program, context, counts);
+	return counts;
+}
+
+/*
+ * Checks that the operations of the given program are well formed, so that it
+ * 	can be executed safely although it is not compiled by
+ * 	<code>brainfuck_compile</code>, and computes its reach. Every jump must
+ * 	be paired with the jump at the other end of its loop, loops must nest
+ * 	and only the last operation may end the program.
+ *
+ * @param program The program to check.
+ * @return <code>0</code> if the program is well formed, <code>-1</code>
+ *	otherwise.
+ */
+int brainfuck_validate_program(BrainfuckProgram *program) {
+	const BrainfuckOperation *operation;
+	size_t *loops = NULL;
+	size_t *grown;
+	size_t depth = 0;
+	size_t allocated = 0;
+	size_t start;
+	size_t n;
+	int result = 0;
+	if (program == NULL || program->operations == NULL || program->length == 0 ||
+			program->operations[program->length - 1].opcode != BRAINFUCK_OP_END)
+		return -1;
+	for (n = 0; result == 0 && n < program->length - 1; n++) {
+		operation = &program->operations[n];
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+		case BRAINFUCK_OP_SET:
+		case BRAINFUCK_OP_MUL:
+		case BRAINFUCK_OP_MOVE:
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+		case BRAINFUCK_OP_INPUT:
+			if (operation->argument < 0)
+				result = -1;
+			break;
+		case BRAINFUCK_OP_SCAN:
+			if (operation->argument == 0 || operation->argument < -INT_MAX)
+				result = -1;
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+			if (depth == allocated) {
+				allocated = allocated == 0 ? BRAINFUCK_COMPILE_DEPTH : allocated * 2;
+				grown = realloc(loops, sizeof(size_t) * allocated);
+				if (grown == NULL) {
+					result = -1;
+					break;
+				}
+				loops = grown;
+			}
+			loops[depth++] = n;
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			if (depth == 0) {
+				result = -1;
+				break;
+			}
+			start = loops[--depth];
+			if (operation->argument <= 0 || (size_t) operation->argument != n - start ||
+					program->operations[start].argument != operation->argument)
+				result = -1;
+			break;
+		default:
+			result = -1;
+		}
+	}
+	free(loops);
+	if (result < 0 || depth > 0)
+		return -1;
+	program->reach = brainfuck_compile_reach(program);
+	return 0;
+}
+
+/*
+ * Destroys a compiled program.
+ *
+ * @param program The program to destroy.
+ */
+void brainfuck_destroy_program(BrainfuckProgram *program) {
+	if (program == NULL)
+		return;
+#ifdef BRAINFUCK_COMPILE_MMAP
+	if (program->map != NULL)
+		munmap(program->map, program->map_size);
+	else
+#endif
+		free(program->operations);
+	free(program->positions);
+#ifdef BRAINFUCK_THREADED_DISPATCH
+	BrainfuckThreadedCode *code;
+	while ((code = (BrainfuckThreadedCode *) program->threaded) != NULL) {
+		program->threaded = code->next;
+		free(code);
+	}
+#endif
+	free(program);
+	program = 0;
+}
+
+/*
+ * A loop that is opened by a parser, but not yet closed.
+ */
+typedef struct BrainfuckParserLoop {
+	/*
+	 * The index of the operation that jumps past the loop.
+	 */
+	size_t start;
+	/*
+	 * The line and column of the '[' in the source.
+	 */
+	size_t line;
+	size_t column;
+} BrainfuckParserLoop;
+
+/*
+ * The maximum amount of cells a transfer loop may modify besides the current
+ * 	cell in order to be rewritten by a parser.
+ */
+#define BRAINFUCK_PARSER_MAX_TARGETS 16
+
+/*
+ * Creates a parser that compiles source that is fed to it in chunks. Clear,
+ * 	scan and transfer loops are rewritten as they are closed, so the
+ * 	memory it uses grows with the compiled program rather than with the
+ * 	source.
+ *
+ * @return The parser or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckParser * brainfuck_parser() {
+	BrainfuckParser *parser = calloc(1, sizeof(BrainfuckParser));
+	if (parser == NULL)
+		return NULL;
+	parser->program = calloc(1, sizeof(BrainfuckProgram));
+	parser->capacity = BRAINFUCK_PROGRAM_CAPACITY;
+	if (parser->program != NULL)
+		parser->program->operations = malloc(sizeof(BrainfuckOperation) * parser->capacity);
+	if (parser->program == NULL || parser->program->operations == NULL) {
+		brainfuck_destroy_parser(parser);
+		return NULL;
+	}
+	parser->line = 1;
+	parser->column = 1;
+	parser->cell_wrap = 1;
+	parser->rewrite = 1;
+	return parser;
+}
+
+/*
+ * Emits the run of commands the given parser holds back. Additions to a cell
+ * 	that is just set are folded into the set, e.g. "[-]+++", unless cells do
+ * 	not wrap and the result leaves the range of a byte.
+ *
+ * @param parser The parser.
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+static int brainfuck_parser_flush(BrainfuckParser *parser) {
+	BrainfuckProgram *program = parser->program;
+	BrainfuckOperation *last = program->length > 0 ? &program->operations[program->length - 1] : NULL;
+	long amount = parser->amount;
+	char run = parser->run;
+	int opcode;
+	parser->run = 0;
+	parser->amount = 0;
+	switch (run) {
+	case 0:
+		return 0;
+	case BRAINFUCK_TOKEN_PLUS:
+		if (last != NULL && last->opcode == BRAINFUCK_OP_SET && last->offset == 0 &&
+				amount > INT_MIN - (long) last->argument && amount < INT_MAX - (long) last->argument &&
+				(parser->cell_wrap || (last->argument + amount >= 0 && last->argument + amount <= 255))) {
+			last->argument += (int) amount;
+			return 0;
+		}
+		opcode = BRAINFUCK_OP_ADD;
+		break;
+	case BRAINFUCK_TOKEN_NEXT:
+		opcode = BRAINFUCK_OP_MOVE;
+		break;
+	case BRAINFUCK_TOKEN_OUTPUT:
+		opcode = BRAINFUCK_OP_OUTPUT;
+		break;
+	default:
+		opcode = BRAINFUCK_OP_INPUT;
+	}
+	return brainfuck_compile_emit_amount(program, &parser->capacity, opcode, amount, 0);
+}
+
+/*
+ * Rewrites the body of the innermost loop of the given parser, which runs up
+ * 	to the end of the program, if it is a clear, scan or transfer loop.
+ *
+ * @param parser The parser.
+ * @param start The index of the operation that starts the loop.
+ * @return <code>1</code> if the loop is rewritten, <code>0</code> otherwise.
+ */
+static int brainfuck_parser_rewrite(BrainfuckParser *parser, size_t start) {
+	BrainfuckProgram *program = parser->program;
+	BrainfuckOperation *operation;
+	long offsets[BRAINFUCK_PARSER_MAX_TARGETS + 1];
+	long deltas[BRAINFUCK_PARSER_MAX_TARGETS + 1];
+	long position = 0;
+	int count = 1;
+	int i;
+	size_t n;
+	offsets[0] = 0;
+	deltas[0] = 0;
+	// "[>]" and "[<<]"
+	if (program->length == start + 2 && program->operations[start + 1].opcode == BRAINFUCK_OP_MOVE) {
+		program->operations[start].opcode = BRAINFUCK_OP_SCAN;
+		program->operations[start].argument = program->operations[start + 1].argument;
+		program->length = start + 1;
+		return 1;
+	}
+	for (n = start + 1; n < program->length; n++) {
+		operation = &program->operations[n];
+		if (operation->opcode == BRAINFUCK_OP_MOVE) {
+			position += operation->argument;
+			continue;
+		}
+		if (operation->opcode != BRAINFUCK_OP_ADD)
+			return 0;
+		for (i = 0; i < count && offsets[i] != position; i++)
+			;
+		if (i == count) {
+			if (count > BRAINFUCK_PARSER_MAX_TARGETS)
+				return 0;
+			offsets[count] = position;
+			deltas[count++] = 0;
+		}
+		deltas[i] += operation->argument;
+	}
+	// "[+]" only ends once the cell wraps around
+	if (position != 0 || (deltas[0] != -1 && (deltas[0] != 1 || !parser->cell_wrap)))
+		return 0;
+	for (i = 1; i < count; i++) {
+		if (offsets[i] > INT_MAX || offsets[i] < -INT_MAX || deltas[i] > INT_MAX || deltas[i] < -INT_MAX)
+			return 0;
+	}
+
+	/*
+	 * The body holds at least one operation per target, so the
+	 * 	multiplications and the clear of "[->+>++<<]" fit in its place.
+	 */
+	program->length = start;
+	for (i = 1; i < count; i++) {
+		if (deltas[i] != 0)
+			brainfuck_compile_emit(program, &parser->capacity, BRAINFUCK_OP_MUL,
+					(int) (deltas[i] * -deltas[0]), (int) offsets[i]);
+	}
+	brainfuck_compile_emit(program, &parser->capacity, BRAINFUCK_OP_SET, 0, 0);
+	return 1;
+}
+
+/*
+ * Reports an error of the given parser.
+ *
+ * @param parser The parser.
+ * @param c The bracket that has no match.
+ * @param line The line of the bracket.
+ * @param column The column of the bracket.
+ * @return <code>-1</code>.
+ */
+static int brainfuck_parser_unmatched(BrainfuckParser *parser, char c, size_t line, size_t column) {
+	char message[128];
+	snprintf(message, sizeof(message), "error: unmatched '%c' at line %zu, column %zu\n", c, line, column);
+	if (parser->report_handler != NULL)
+		parser->report_handler(message, strlen(message));
+	else
+		fputs(message, stderr);
+	parser->failed = 1;
+	return -1;
+}
+
+/*
+ * Feeds the next chunk of source to the given parser. Chunks may end anywhere,
+ * 	including inside a run of commands or a loop.
+ *
+ * @param parser The parser.
+ * @param chunk The chunk.
+ * @param length The length of the chunk.
+ * @return <code>0</code> on success, <code>-1</code> if a bracket has no
+ *	match or memory could not be allocated.
+ */
+int brainfuck_parser_feed(BrainfuckParser *parser, const char *chunk, size_t length) {
+	BrainfuckProgram *program;
+	BrainfuckParserLoop *grown;
+	size_t start;
+	size_t n;
+	char run;
+	char c;
+	if (parser == NULL || (chunk == NULL && length > 0) || parser->failed)
+		return -1;
+	program = parser->program;
+	for (n = 0; n < length; n++) {
+		c = chunk[n];
+		switch (c) {
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+			run = BRAINFUCK_TOKEN_PLUS;
+			break;
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			run = BRAINFUCK_TOKEN_NEXT;
+			break;
+		case BRAINFUCK_TOKEN_OUTPUT:
+		case BRAINFUCK_TOKEN_INPUT:
+			run = c;
+			break;
+		case '\n':
+			parser->line++;
+			parser->column = 1;
+			continue;
+		case BRAINFUCK_TOKEN_LOOP_START:
+		case BRAINFUCK_TOKEN_LOOP_END:
+			run = 0;
+			break;
+		default:
+			parser->column++;
+			continue;
+		}
+		// runs continue across comments and chunks, like "+ +" or "+|+"
+		if (run != parser->run && brainfuck_parser_flush(parser) < 0) {
+			parser->failed = 1;
+			return -1;
+		}
+		if (run != 0) {
+			parser->run = run;
+			parser->amount += c == BRAINFUCK_TOKEN_MINUS || c == BRAINFUCK_TOKEN_PREVIOUS ? -1 : 1;
+			parser->column++;
+			continue;
+		}
+		if (c == BRAINFUCK_TOKEN_LOOP_START) {
+			if (parser->depth == parser->allocated) {
+				parser->allocated = parser->allocated == 0 ? BRAINFUCK_COMPILE_DEPTH : parser->allocated * 2;
+				grown = realloc(parser->loops, sizeof(BrainfuckParserLoop) * parser->allocated);
+				if (grown == NULL) {
+					parser->failed = 1;
+					return -1;
+				}
+				parser->loops = grown;
+			}
+			parser->loops[parser->depth].start = program->length;
+			parser->loops[parser->depth].line = parser->line;
+			parser->loops[parser->depth++].column = parser->column;
+			if (brainfuck_compile_emit(program, &parser->capacity, BRAINFUCK_OP_JUMP_ZERO, 0, 0) < 0) {
+				parser->failed = 1;
+				return -1;
+			}
+		} else {
+			if (parser->depth == 0)
+				return brainfuck_parser_unmatched(parser, c, parser->line, parser->column);
+			start = parser->loops[--parser->depth].start;
+			if (!parser->rewrite || !brainfuck_parser_rewrite(parser, start)) {
+				if (program->length - start > INT_MAX || brainfuck_compile_emit(program, &parser->capacity,
+						BRAINFUCK_OP_JUMP_NONZERO, (int) (program->length - start), 0) < 0) {
+					parser->failed = 1;
+					return -1;
+				}
+				program->operations[start].argument = (int) (program->length - 1 - start);
+			}
+		}
+		parser->column++;
+	}
+	return 0;
+}
+
+/*
+ * Completes the program of the given parser once all source is fed to it.
+ *
+ * @param parser The parser, which must still be destroyed afterwards.
+ * @return The program, which is no longer owned by the parser, or
+ *	<code>NULL</code> if a bracket has no match or memory could not be
+ *	allocated.
+ */
+BrainfuckProgram * brainfuck_parser_finish(BrainfuckParser *parser) {
+	BrainfuckProgram *program;
+	BrainfuckParserLoop *loop;
+	if (parser == NULL || parser->failed || parser->program == NULL)
+		return NULL;
+	if (parser->depth > 0) {
+		loop = &parser->loops[parser->depth - 1];
+		brainfuck_parser_unmatched(parser, BRAINFUCK_TOKEN_LOOP_START, loop->line, loop->column);
+		return NULL;
+	}
+	program = parser->program;
+	if (brainfuck_parser_flush(parser) < 0 ||
+			brainfuck_compile_emit(program, &parser->capacity, BRAINFUCK_OP_END, 0, 0) < 0) {
+		parser->failed = 1;
+		return NULL;
+	}
+	program->reach = brainfuck_compile_reach(program);
+	parser->program = NULL;
+	return program;
+}
+
+/*
+ * Destroys a parser and the program it is building, unless it is finished.
+ *
+ * @param parser The parser to destroy.
+ */
+void brainfuck_destroy_parser(BrainfuckParser *parser) {
+	if (parser == NULL)
+		return;
+	brainfuck_destroy_program(parser->program);
+	free(parser->loops);
+	free(parser);
+	parser = 0;
+}
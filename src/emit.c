@@ -0,0 +1,278 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The amount of nested loops the translator makes room for once it finds a
+ * 	loop. The stack grows on the heap, so the nesting depth is not limited
+ * 	by the C stack.
+ */
+#define BRAINFUCK_EMIT_DEPTH 64
+
+/*
+ * The deepest indentation of the translated statements. Deeper loops are
+ * 	indented like this one, so the output stays proportional to the
+ * 	program.
+ */
+#define BRAINFUCK_EMIT_MAX_INDENT 32
+
+/*
+ * The code that precedes the translated program. It contains the tape, the
+ * 	buffered I/O functions and the bounds checks.
+ */
+static const char *brainfuck_emit_prologue =
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"static unsigned char tape[TAPE_SIZE];\n"
+	"static unsigned char output[4096];\n"
+	"static size_t output_length;\n"
+	"\n"
+	"static void flush(void) {\n"
+	"\tfwrite(output, 1, output_length, stdout);\n"
+	"\tfflush(stdout);\n"
+	"\toutput_length = 0;\n"
+	"}\n"
+	"\n"
+	"static void put(unsigned char c, long count) {\n"
+	"\twhile (count-- > 0) {\n"
+	"\t\tif (output_length == sizeof(output))\n"
+	"\t\t\tflush();\n"
+	"\t\toutput[output_length++] = c;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"static unsigned char get(long count) {\n"
+	"\tint c = 0;\n"
+	"\tflush();\n"
+	"\twhile (count-- > 0)\n"
+	"\t\tc = getchar();\n"
+	"\treturn (unsigned char) c;\n"
+	"}\n"
+	"\n"
+	"static void out_of_bounds(long index) {\n"
+	"\tflush();\n"
+	"\tif (index < 0)\n"
+	"\t\tfprintf(stderr, \"error: tape memory out of bounds (underrun)\\nundershot the tape size of %d cells\\n\", TAPE_SIZE);\n"
+	"\telse\n"
+	"\t\tfprintf(stderr, \"error: tape memory out of bounds (overrun)\\nexceeded the tape size of %d cells\\n\", TAPE_SIZE);\n"
+	"\texit(EXIT_FAILURE);\n"
+	"}\n"
+	"\n"
+	"#define CHECK(index) if ((unsigned long) (index) >= TAPE_SIZE) out_of_bounds(index)\n"
+	"\n"
+	"static long scan(long i, long stride) {\n"
+	"\tunsigned char *found;\n"
+	"\tif (stride == 1) {\n"
+	"\t\tfound = memchr(tape + i, 0, TAPE_SIZE - i);\n"
+	"\t\tif (found == NULL)\n"
+	"\t\t\tout_of_bounds(TAPE_SIZE);\n"
+	"\t\treturn found - tape;\n"
+	"\t}\n"
+	"\twhile (tape[i]) {\n"
+	"\t\ti += stride;\n"
+	"\t\tCHECK(i);\n"
+	"\t}\n"
+	"\treturn i;\n"
+	"}\n"
+	"\n"
+	"int main(void) {\n"
+	"\tlong i = 0;\n"
+	"\t(void) put, (void) get, (void) scan;\n";
+
+/*
+ * Writes the given amount of tabs to the stream.
+ *
+ * @param stream The stream to write to.
+ * @param depth The amount of tabs.
+ */
+static void brainfuck_emit_indent(FILE *stream, int depth) {
+	if (depth > BRAINFUCK_EMIT_MAX_INDENT)
+		depth = BRAINFUCK_EMIT_MAX_INDENT;
+	while (depth-- > 0)
+		fputc('\t', stream);
+}
+
+/*
+ * Writes the expression that indexes the cell at the given offset.
+ *
+ * @param stream The stream to write to.
+ * @param offset The offset of the cell relative to the current cell.
+ */
+static void brainfuck_emit_cell(FILE *stream, long offset) {
+	if (offset > 0)
+		fprintf(stream, "tape[i + %ld]", offset);
+	else if (offset < 0)
+		fprintf(stream, "tape[i - %ld]", -offset);
+	else
+		fputs("tape[i]", stream);
+}
+
+/*
+ * Writes a bounds check for the cell at the given offset. The current cell is
+ * 	always in bounds, so it is not checked.
+ *
+ * @param stream The stream to write to.
+ * @param offset The offset of the cell relative to the current cell.
+ * @param depth The indentation depth.
+ */
+static void brainfuck_emit_check(FILE *stream, long offset, int depth) {
+	if (offset == 0)
+		return;
+	brainfuck_emit_indent(stream, depth);
+	fprintf(stream, "CHECK(i %c %ld);\n", offset > 0 ? '+' : '-', offset > 0 ? offset : -offset);
+}
+
+/*
+ * Translates the given linked list containing instructions into C statements.
+ * 	The loops that are entered are kept on a stack on the heap.
+ *
+ * @param stream The stream to write to.
+ * @param instruction The start of the linked list of instructions.
+ * @param depth The indentation depth.
+ * @return <code>0</code> on success, <code>-1</code> if memory could not be
+ *	allocated.
+ */
+static int brainfuck_emit_list(FILE *stream, BrainfuckInstruction *instruction, int depth) {
+	BrainfuckInstruction **loops = NULL;
+	BrainfuckInstruction **grown;
+	size_t nesting = 0;
+	size_t capacity = 0;
+	long amount;
+	for (;;) {
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			if (nesting == 0)
+				break;
+			// close the innermost loop and continue after it
+			instruction = loops[--nesting];
+			depth--;
+			brainfuck_emit_indent(stream, depth);
+			fputs("}\n", stream);
+			instruction = instruction->next;
+			continue;
+		}
+		switch (instruction->type) {
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+			amount = (long) instruction->difference;
+			if (instruction->type == BRAINFUCK_TOKEN_MINUS)
+				amount = -amount;
+			brainfuck_emit_check(stream, instruction->offset, depth);
+			brainfuck_emit_indent(stream, depth);
+			brainfuck_emit_cell(stream, instruction->offset);
+			fprintf(stream, " += %u;\n", (unsigned char) amount);
+			break;
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			amount = (long) instruction->difference;
+			if (instruction->type == BRAINFUCK_TOKEN_PREVIOUS)
+				amount = -amount;
+			if (amount == 0)
+				break;
+			brainfuck_emit_indent(stream, depth);
+			fprintf(stream, "i %c= %ld;\n", amount > 0 ? '+' : '-', amount > 0 ? amount : -amount);
+			brainfuck_emit_indent(stream, depth);
+			fputs("CHECK(i);\n", stream);
+			break;
+		case BRAINFUCK_TOKEN_OUTPUT:
+			brainfuck_emit_check(stream, instruction->offset, depth);
+			brainfuck_emit_indent(stream, depth);
+			fputs("put(", stream);
+			brainfuck_emit_cell(stream, instruction->offset);
+			fprintf(stream, ", %lu);\n", instruction->difference);
+			break;
+		case BRAINFUCK_TOKEN_INPUT:
+			brainfuck_emit_check(stream, instruction->offset, depth);
+			brainfuck_emit_indent(stream, depth);
+			brainfuck_emit_cell(stream, instruction->offset);
+			fprintf(stream, " = get(%lu);\n", instruction->difference);
+			break;
+		case BRAINFUCK_TOKEN_LOOP_START:
+			if (nesting == capacity) {
+				capacity = capacity == 0 ? BRAINFUCK_EMIT_DEPTH : capacity * 2;
+				grown = realloc(loops, sizeof(BrainfuckInstruction *) * capacity);
+				if (grown == NULL) {
+					free(loops);
+					return -1;
+				}
+				loops = grown;
+			}
+			brainfuck_emit_indent(stream, depth);
+			fputs("while (tape[i]) {\n", stream);
+			loops[nesting++] = instruction;
+			depth++;
+			instruction = instruction->loop;
+			continue;
+		case BRAINFUCK_INSTRUCTION_SET:
+			brainfuck_emit_check(stream, instruction->offset, depth);
+			brainfuck_emit_indent(stream, depth);
+			brainfuck_emit_cell(stream, instruction->offset);
+			fprintf(stream, " = %u;\n", (unsigned char) instruction->difference);
+			break;
+		case BRAINFUCK_INSTRUCTION_MUL:
+			// the loop this is derived from would not have moved on a zero cell
+			brainfuck_emit_indent(stream, depth);
+			fputs("if (tape[i]) {\n", stream);
+			brainfuck_emit_check(stream, instruction->offset, depth + 1);
+			brainfuck_emit_indent(stream, depth + 1);
+			brainfuck_emit_cell(stream, instruction->offset);
+			fprintf(stream, " += tape[i] * %u;\n", (unsigned char) instruction->difference);
+			brainfuck_emit_indent(stream, depth);
+			fputs("}\n", stream);
+			break;
+		case BRAINFUCK_INSTRUCTION_SCAN:
+			brainfuck_emit_indent(stream, depth);
+			fprintf(stream, "i = scan(i, %ld);\n", (long) instruction->difference);
+			break;
+		default:
+			free(loops);
+			return 0;
+		}
+		instruction = instruction->next;
+	}
+	free(loops);
+	return 0;
+}
+
+/*
+ * Translates the given linked list containing instructions into a
+ * 	self-contained C program that uses a tape of the given size, wraps cells
+ * 	around like <code>brainfuck_execute</code> and buffers its output.
+ *
+ * @param stream The stream to write the C program to.
+ * @param root The start of the linked list of instructions you want to translate.
+ * @param size The size of the tape.
+ * @return <code>0</code> on success, <code>-1</code> if writing failed.
+ */
+int brainfuck_emit_c(FILE *stream, BrainfuckInstruction *root, int size) {
+	if (stream == NULL)
+		return -1;
+	if (size < 0)
+		size = BRAINFUCK_TAPE_SIZE;
+	fprintf(stream, "/* Generated by brainfuck %s */\n", BRAINFUCK_VERSION);
+	fprintf(stream, "#define TAPE_SIZE %d\n\n", size);
+	fputs(brainfuck_emit_prologue, stream);
+	if (brainfuck_emit_list(stream, root, 1) < 0)
+		return -1;
+	fputs("\tflush();\n\treturn EXIT_SUCCESS;\n}\n", stream);
+	return ferror(stream) ? -1 : 0;
+}
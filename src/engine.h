@@ -0,0 +1,404 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The execution engines for compiled programs. This file is included once for
+ * 	every variant of the engines, after defining:
+ *
+ * BRAINFUCK_ENGINE_BITS The width of a cell in bits: 8, 16 or 32.
+ * BRAINFUCK_ENGINE_WRAP <code>1</code> if cells wrap around,
+ *	<code>0</code> if leaving the range of a cell is an error.
+ * BRAINFUCK_ENGINE_CHECKED <code>1</code> if every tape index is checked,
+ *	<code>0</code> if the guard pages around the tape are relied upon.
+ *
+ * The engines are named <code>brainfuck_engine_switch_BITS_WRAP_CHECKED</code>
+ * 	and <code>brainfuck_engine_threaded_BITS_WRAP_CHECKED</code>; the
+ * 	checked variants also define the resumable
+ * 	<code>brainfuck_engine_run_BITS_WRAP_1</code>. Scans
+ * 	always check the index they end at, since they stop at the end of the
+ * 	tape rather than running into the guard pages.
+ *
+ * If <code>BRAINFUCK_ENGINE_PROFILE</code> is defined as <code>1</code>,
+ * 	only the <code>switch</code> engine is defined instead, as
+ * 	<code>brainfuck_engine_profile_BITS_WRAP_CHECKED</code>, which counts
+ * 	the executions of every operation in an array it is given.
+ */
+
+#ifndef BRAINFUCK_ENGINE_PROFILE
+#	define BRAINFUCK_ENGINE_PROFILE 0
+#endif
+
+#define BRAINFUCK_ENGINE_CONCAT(engine, bits, wrap, checked) \
+	brainfuck_engine_ ## engine ## _ ## bits ## _ ## wrap ## _ ## checked
+#define BRAINFUCK_ENGINE_EXPAND(engine, bits, wrap, checked) \
+	BRAINFUCK_ENGINE_CONCAT(engine, bits, wrap, checked)
+#define BRAINFUCK_ENGINE_NAME(engine) BRAINFUCK_ENGINE_EXPAND(engine, \
+	BRAINFUCK_ENGINE_BITS, BRAINFUCK_ENGINE_WRAP, BRAINFUCK_ENGINE_CHECKED)
+
+#if BRAINFUCK_ENGINE_BITS == 8
+#	define BRAINFUCK_ENGINE_CELL unsigned char
+#	define BRAINFUCK_ENGINE_MAX UCHAR_MAX
+#	define BRAINFUCK_ENGINE_SCAN(tape, size, index, stride) \
+		brainfuck_scan((const char *) (tape), size, index, stride)
+#elif BRAINFUCK_ENGINE_BITS == 16
+#	define BRAINFUCK_ENGINE_CELL uint16_t
+#	define BRAINFUCK_ENGINE_MAX UINT16_MAX
+#	define BRAINFUCK_ENGINE_SCAN brainfuck_compile_scan16
+#else
+#	define BRAINFUCK_ENGINE_CELL uint32_t
+#	define BRAINFUCK_ENGINE_MAX UINT32_MAX
+#	define BRAINFUCK_ENGINE_SCAN brainfuck_compile_scan32
+#endif
+
+#if BRAINFUCK_ENGINE_CHECKED
+#	define BRAINFUCK_ENGINE_CHECK(context, index) BRAINFUCK_CHECK_INDEX(context, index)
+#else
+#	define BRAINFUCK_ENGINE_CHECK(context, index) (void) 0
+#endif
+
+/*
+ * Stores a value that is computed with 64-bit arithmetic into a cell, either
+ * 	wrapping it around or terminating the program if it does not fit.
+ */
+#if BRAINFUCK_ENGINE_WRAP
+#	define BRAINFUCK_ENGINE_VALUE unsigned long long
+#	define BRAINFUCK_ENGINE_STORE(context, cell, value) \
+		(cell) = (BRAINFUCK_ENGINE_CELL) (value)
+#else
+#	define BRAINFUCK_ENGINE_VALUE long long
+#	define BRAINFUCK_ENGINE_STORE(context, cell, value) do { \
+		long long stored = (value); \
+		if (stored < 0 || stored > (long long) BRAINFUCK_ENGINE_MAX) \
+			brainfuck_overflow(context, stored); \
+		(cell) = (BRAINFUCK_ENGINE_CELL) stored; \
+	} while (0)
+#endif
+
+#if BRAINFUCK_ENGINE_PROFILE
+#	define BRAINFUCK_ENGINE_COUNT(operation) counts[(operation) - program->operations]++
+
+/*
+ * Executes the given compiled program using a portable <code>switch</code>
+ * 	dispatch loop and counts the executions of every operation.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ * @param counts The counts, indexed like the operations of the program.
+ */
+static void BRAINFUCK_ENGINE_NAME(profile)(BrainfuckProgram *program, BrainfuckExecutionContext *context,
+		unsigned long long *counts) {
+#else
+#	define BRAINFUCK_ENGINE_COUNT(operation) (void) 0
+
+/*
+ * Executes the given compiled program using a portable <code>switch</code>
+ * 	dispatch loop.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+static void BRAINFUCK_ENGINE_NAME(switch)(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+#endif
+	const BrainfuckOperation *operation = program->operations;
+	BRAINFUCK_ENGINE_CELL *tape = (BRAINFUCK_ENGINE_CELL *) context->tape;
+	const size_t size = context->tape_size;
+	long index = context->tape_index;
+	long target;
+	int i;
+	for (;; operation++) {
+		BRAINFUCK_ENGINE_COUNT(operation);
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+			target = index + operation->offset;
+			BRAINFUCK_ENGINE_CHECK(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target],
+					(BRAINFUCK_ENGINE_VALUE) tape[target] + (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_SET:
+			target = index + operation->offset;
+			BRAINFUCK_ENGINE_CHECK(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target], (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_MUL:
+			// the loop this is derived from would not have moved on a zero cell
+			if (!tape[index])
+				break;
+			target = index + operation->offset;
+			BRAINFUCK_ENGINE_CHECK(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target], (BRAINFUCK_ENGINE_VALUE) tape[target] +
+					(BRAINFUCK_ENGINE_VALUE) tape[index] * (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_SCAN:
+			index = BRAINFUCK_ENGINE_SCAN(tape, size, index, operation->argument);
+			BRAINFUCK_CHECK_INDEX(context, index);
+			break;
+		case BRAINFUCK_OP_MOVE:
+			index += operation->argument;
+			BRAINFUCK_ENGINE_CHECK(context, index);
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+			target = index + operation->offset;
+			BRAINFUCK_ENGINE_CHECK(context, target);
+			brainfuck_output(context, (int) tape[target], operation->argument);
+			break;
+		case BRAINFUCK_OP_INPUT:
+			target = index + operation->offset;
+			BRAINFUCK_ENGINE_CHECK(context, target);
+			for (i = 0; i < operation->argument; i++)
+				tape[target] = (BRAINFUCK_ENGINE_CELL) brainfuck_input(context, (int) tape[target]);
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+			if (!tape[index])
+				operation += operation->argument;
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			if (tape[index]) {
+				operation -= operation->argument;
+				// only poll the stop flag on backward jumps
+				if (context->shouldStop == 1) {
+					context->tape_index = index;
+					brainfuck_flush(context);
+					return;
+				}
+			}
+			break;
+		default:
+			context->tape_index = index;
+			brainfuck_flush(context);
+			return;
+		}
+	}
+}
+
+#if defined(BRAINFUCK_THREADED_DISPATCH) && !BRAINFUCK_ENGINE_PROFILE
+/*
+ * Executes the given compiled program using direct-threaded dispatch.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+static void BRAINFUCK_ENGINE_NAME(threaded)(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	static const void *handlers[] = {
+		[BRAINFUCK_OP_ADD] = &&op_add,
+		[BRAINFUCK_OP_SET] = &&op_set,
+		[BRAINFUCK_OP_MUL] = &&op_mul,
+		[BRAINFUCK_OP_SCAN] = &&op_scan,
+		[BRAINFUCK_OP_MOVE] = &&op_move,
+		[BRAINFUCK_OP_OUTPUT] = &&op_output,
+		[BRAINFUCK_OP_INPUT] = &&op_input,
+		[BRAINFUCK_OP_JUMP_ZERO] = &&op_jump_zero,
+		[BRAINFUCK_OP_JUMP_NONZERO] = &&op_jump_nonzero,
+		[BRAINFUCK_OP_END] = &&op_end
+	};
+	const BrainfuckThreadedOperation *code = brainfuck_compile_threaded(program, handlers);
+	if (code == NULL) {
+		BRAINFUCK_ENGINE_NAME(switch)(program, context);
+		return;
+	}
+
+	/*
+	 * The current cell is kept in a local and cells at an offset are addressed
+	 * 	relative to it, so the tape index is only written back on exit.
+	 */
+	const BrainfuckThreadedOperation *operation = code;
+	BRAINFUCK_ENGINE_CELL *tape = (BRAINFUCK_ENGINE_CELL *) context->tape;
+	const size_t size = context->tape_size;
+	BRAINFUCK_ENGINE_CELL *cell = tape + context->tape_index;
+	long index;
+	int i;
+#define DISPATCH() goto *operation->handler
+#define NEXT() do { operation++; DISPATCH(); } while (0)
+#define TARGET() do { \
+		index = (cell - tape) + operation->offset; \
+		BRAINFUCK_ENGINE_CHECK(context, index); \
+	} while (0)
+	DISPATCH();
+op_add:
+	TARGET();
+	BRAINFUCK_ENGINE_STORE(context, tape[index],
+			(BRAINFUCK_ENGINE_VALUE) tape[index] + (BRAINFUCK_ENGINE_VALUE) operation->argument);
+	NEXT();
+op_set:
+	TARGET();
+	BRAINFUCK_ENGINE_STORE(context, tape[index], (BRAINFUCK_ENGINE_VALUE) operation->argument);
+	NEXT();
+op_mul:
+	// the loop this is derived from would not have moved on a zero cell
+	if (!*cell)
+		NEXT();
+	TARGET();
+	BRAINFUCK_ENGINE_STORE(context, tape[index], (BRAINFUCK_ENGINE_VALUE) tape[index] +
+			(BRAINFUCK_ENGINE_VALUE) *cell * (BRAINFUCK_ENGINE_VALUE) operation->argument);
+	NEXT();
+op_scan:
+	index = BRAINFUCK_ENGINE_SCAN(tape, size, cell - tape, operation->argument);
+	BRAINFUCK_CHECK_INDEX(context, index);
+	cell = tape + index;
+	NEXT();
+op_move:
+	index = (cell - tape) + operation->argument;
+	BRAINFUCK_ENGINE_CHECK(context, index);
+	cell = tape + index;
+	NEXT();
+op_output:
+	TARGET();
+	brainfuck_output(context, (int) tape[index], operation->argument);
+	NEXT();
+op_input:
+	TARGET();
+	for (i = 0; i < operation->argument; i++)
+		tape[index] = (BRAINFUCK_ENGINE_CELL) brainfuck_input(context, (int) tape[index]);
+	NEXT();
+op_jump_zero:
+	if (!*cell)
+		operation += operation->argument;
+	NEXT();
+op_jump_nonzero:
+	if (*cell) {
+		operation -= operation->argument;
+		// only poll the stop flag on backward jumps
+		if (context->shouldStop == 1)
+			goto op_end;
+	}
+	NEXT();
+op_end:
+#undef TARGET
+#undef NEXT
+#undef DISPATCH
+	context->tape_index = cell - tape;
+	brainfuck_flush(context);
+}
+#endif
+
+#if BRAINFUCK_ENGINE_CHECKED && !BRAINFUCK_ENGINE_PROFILE
+/*
+ * Executes the given compiled program from the operation the context stopped
+ * 	at until it ends, the given fuel is used up or it waits for input. Fuel
+ * 	is only accounted for when a loop repeats: every iteration costs the
+ * 	length of the loop body.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution.
+ * @param fuel The amount of operations that may be executed.
+ * @return The reason execution stopped.
+ */
+static BrainfuckStatus BRAINFUCK_ENGINE_NAME(run)(BrainfuckProgram *program, BrainfuckExecutionContext *context,
+		long fuel) {
+	const BrainfuckOperation *operation = program->operations + context->program_counter;
+	BRAINFUCK_ENGINE_CELL *tape = (BRAINFUCK_ENGINE_CELL *) context->tape;
+	const size_t size = context->tape_size;
+	long index = context->tape_index;
+	long target;
+	unsigned long count;
+	int value;
+	BrainfuckStatus status;
+	for (;; operation++) {
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+			target = index + operation->offset;
+			BRAINFUCK_CHECK_INDEX(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target],
+					(BRAINFUCK_ENGINE_VALUE) tape[target] + (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_SET:
+			target = index + operation->offset;
+			BRAINFUCK_CHECK_INDEX(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target], (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_MUL:
+			// the loop this is derived from would not have moved on a zero cell
+			if (!tape[index])
+				break;
+			target = index + operation->offset;
+			BRAINFUCK_CHECK_INDEX(context, target);
+			BRAINFUCK_ENGINE_STORE(context, tape[target], (BRAINFUCK_ENGINE_VALUE) tape[target] +
+					(BRAINFUCK_ENGINE_VALUE) tape[index] * (BRAINFUCK_ENGINE_VALUE) operation->argument);
+			break;
+		case BRAINFUCK_OP_SCAN:
+			index = BRAINFUCK_ENGINE_SCAN(tape, size, index, operation->argument);
+			BRAINFUCK_CHECK_INDEX(context, index);
+			break;
+		case BRAINFUCK_OP_MOVE:
+			index += operation->argument;
+			BRAINFUCK_CHECK_INDEX(context, index);
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+			target = index + operation->offset;
+			BRAINFUCK_CHECK_INDEX(context, target);
+			brainfuck_output(context, (int) tape[target], operation->argument);
+			break;
+		case BRAINFUCK_OP_INPUT:
+			target = index + operation->offset;
+			BRAINFUCK_CHECK_INDEX(context, target);
+			// a run that waited for input resumes with the characters it still needs
+			count = context->input_pending ? context->input_pending : (unsigned long) operation->argument;
+			for (; count > 0; count--) {
+				if (!brainfuck_input_poll(context, (int) tape[target], &value)) {
+					context->input_pending = count;
+					status = BRAINFUCK_STATUS_INPUT;
+					goto suspend;
+				}
+				tape[target] = (BRAINFUCK_ENGINE_CELL) value;
+			}
+			context->input_pending = 0;
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+			if (!tape[index])
+				operation += operation->argument;
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			if (tape[index]) {
+				fuel -= operation->argument;
+				operation -= operation->argument;
+				if (fuel <= 0 || context->shouldStop == 1) {
+					status = context->shouldStop == 1 ? BRAINFUCK_STATUS_STOPPED : BRAINFUCK_STATUS_FUEL;
+					operation++;
+					goto suspend;
+				}
+			}
+			break;
+		default:
+			context->program_counter = 0;
+			context->tape_index = index;
+			brainfuck_flush(context);
+			return BRAINFUCK_STATUS_FINISHED;
+		}
+	}
+suspend:
+	context->program_counter = (size_t) (operation - program->operations);
+	context->tape_index = index;
+	brainfuck_flush(context);
+	return status;
+}
+#endif
+
+#undef BRAINFUCK_ENGINE_COUNT
+#undef BRAINFUCK_ENGINE_STORE
+#undef BRAINFUCK_ENGINE_VALUE
+#undef BRAINFUCK_ENGINE_CHECK
+#undef BRAINFUCK_ENGINE_SCAN
+#undef BRAINFUCK_ENGINE_MAX
+#undef BRAINFUCK_ENGINE_CELL
+#undef BRAINFUCK_ENGINE_NAME
+#undef BRAINFUCK_ENGINE_EXPAND
+#undef BRAINFUCK_ENGINE_CONCAT
+#undef BRAINFUCK_ENGINE_PROFILE
+#undef BRAINFUCK_ENGINE_CHECKED
+#undef BRAINFUCK_ENGINE_WRAP
+#undef BRAINFUCK_ENGINE_BITS
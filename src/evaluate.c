@@ -0,0 +1,377 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The largest amount of output that is precomputed.
+ */
+#define BRAINFUCK_EVALUATE_MAX_OUTPUT (1 << 16)
+
+/*
+ * The state of a program that is evaluated at compile time.
+ */
+typedef struct BrainfuckEvaluation {
+	/*
+	 * The tape, which starts at the cell the program starts at.
+	 */
+	uint32_t tape[BRAINFUCK_TAPE_SIZE];
+	/*
+	 * The amount of cells of the tape that may be used.
+	 */
+	long size;
+	/*
+	 * The largest value of a cell.
+	 */
+	long long max;
+	/*
+	 * Whether values that leave the range of a cell wrap around.
+	 */
+	int wrap;
+	/*
+	 * The current cell.
+	 */
+	long index;
+	/*
+	 * One past the highest cell that is written.
+	 */
+	long high;
+	/*
+	 * The output of the program.
+	 */
+	char *output;
+	size_t output_length;
+	size_t output_capacity;
+	/*
+	 * The index of the next operation.
+	 */
+	size_t counter;
+	/*
+	 * The amount of operations that are executed.
+	 */
+	unsigned long steps;
+} BrainfuckEvaluation;
+
+/*
+ * A point the evaluated program can be resumed at: an operation outside of
+ * 	any loop, which every jump of the rest of the program stays behind.
+ */
+typedef struct BrainfuckEvaluateCheckpoint {
+	/*
+	 * The index of the operation.
+	 */
+	size_t counter;
+	/*
+	 * The amount of operations that are executed before it.
+	 */
+	unsigned long steps;
+	/*
+	 * The amount of output that is written before it.
+	 */
+	size_t output_length;
+} BrainfuckEvaluateCheckpoint;
+
+/*
+ * Stores a value in the given cell of the evaluation like the engines do for
+ * 	its cells.
+ *
+ * @param evaluation The evaluation.
+ * @param index The cell.
+ * @param value The value.
+ * @return <code>0</code> on success, <code>-1</code> if the cell is out of
+ *	range or the program would stop with an error.
+ */
+static int brainfuck_evaluate_store(BrainfuckEvaluation *evaluation, long index, long long value) {
+	if (index < 0 || index >= evaluation->size)
+		return -1;
+	if (evaluation->wrap)
+		value = (long long) ((unsigned long long) value & (unsigned long long) evaluation->max);
+	// values are restored as operands, which must fit in an int without wrapping
+	else if (value < 0 || value > evaluation->max || value > INT_MAX)
+		return -1;
+	evaluation->tape[index] = (uint32_t) value;
+	if (index >= evaluation->high)
+		evaluation->high = index + 1;
+	return 0;
+}
+
+/*
+ * Appends output to the evaluation.
+ *
+ * @param evaluation The evaluation.
+ * @param chr The character.
+ * @param count The amount of times the character is written.
+ * @return <code>0</code> on success, <code>-1</code> if the output grows
+ *	too large.
+ */
+static int brainfuck_evaluate_output(BrainfuckEvaluation *evaluation, char chr, long count) {
+	char *grown;
+	size_t capacity = evaluation->output_capacity;
+	if (count < 0 || (size_t) count > BRAINFUCK_EVALUATE_MAX_OUTPUT - evaluation->output_length)
+		return -1;
+	while (evaluation->output_length + (size_t) count > capacity)
+		capacity = capacity == 0 ? 256 : capacity * 2;
+	if (capacity != evaluation->output_capacity) {
+		grown = realloc(evaluation->output, capacity);
+		if (grown == NULL)
+			return -1;
+		evaluation->output = grown;
+		evaluation->output_capacity = capacity;
+	}
+	memset(evaluation->output + evaluation->output_length, chr, (size_t) count);
+	evaluation->output_length += (size_t) count;
+	return 0;
+}
+
+/*
+ * Executes the given program on the evaluation until it would read input, it
+ * 	leaves the range the evaluation supports, it ends or the given amount
+ * 	of operations is executed. Every operation outside of a loop that is
+ * 	reached is recorded as a checkpoint.
+ *
+ * @param program The program.
+ * @param top Whether every operation of the program is outside of any loop.
+ * @param evaluation The evaluation, which starts on a zero tape.
+ * @param limit The largest amount of operations to execute.
+ * @param checkpoint The last checkpoint that is reached.
+ */
+static void brainfuck_evaluate_run(BrainfuckProgram *program, const unsigned char *top,
+		BrainfuckEvaluation *evaluation, unsigned long limit, BrainfuckEvaluateCheckpoint *checkpoint) {
+	const BrainfuckOperation *operation;
+	long target;
+	for (;;) {
+		if (top[evaluation->counter]) {
+			checkpoint->counter = evaluation->counter;
+			checkpoint->steps = evaluation->steps;
+			checkpoint->output_length = evaluation->output_length;
+		}
+		if (evaluation->steps == limit)
+			return;
+		operation = &program->operations[evaluation->counter];
+		target = evaluation->index + operation->offset;
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+			if (target < 0 || target >= evaluation->size || brainfuck_evaluate_store(evaluation, target,
+					(long long) evaluation->tape[target] + operation->argument) < 0)
+				return;
+			break;
+		case BRAINFUCK_OP_SET:
+			if (brainfuck_evaluate_store(evaluation, target, operation->argument) < 0)
+				return;
+			break;
+		case BRAINFUCK_OP_MUL:
+			if (!evaluation->tape[evaluation->index])
+				break;
+			if (target < 0 || target >= evaluation->size || brainfuck_evaluate_store(evaluation, target,
+					(long long) evaluation->tape[target] +
+					(long long) evaluation->tape[evaluation->index] * operation->argument) < 0)
+				return;
+			break;
+		case BRAINFUCK_OP_SCAN:
+			for (target = evaluation->index; evaluation->tape[target]; target += operation->argument) {
+				if (target + operation->argument < 0 || target + operation->argument >= evaluation->size)
+					return;
+			}
+			evaluation->index = target;
+			break;
+		case BRAINFUCK_OP_MOVE:
+			target = evaluation->index + operation->argument;
+			if (target < 0 || target >= evaluation->size)
+				return;
+			evaluation->index = target;
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+			if (target < 0 || target >= evaluation->size ||
+					brainfuck_evaluate_output(evaluation, (char) evaluation->tape[target], operation->argument) < 0)
+				return;
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+			if (!evaluation->tape[evaluation->index])
+				evaluation->counter += operation->argument;
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			if (evaluation->tape[evaluation->index])
+				evaluation->counter -= operation->argument;
+			break;
+		default:
+			// input depends on the run, and the program ends at the last operation
+			return;
+		}
+		evaluation->counter++;
+		evaluation->steps++;
+	}
+}
+
+/*
+ * Appends an operation to the given array.
+ *
+ * @param operations The operations.
+ * @param length The pointer to the amount of operations.
+ * @param opcode The opcode of the operation.
+ * @param argument The operand of the operation.
+ * @param offset The offset of the cell the operation operates on.
+ */
+static void brainfuck_evaluate_emit(BrainfuckOperation *operations, size_t *length,
+		int opcode, int argument, int offset) {
+	operations[*length].opcode = opcode;
+	operations[*length].argument = argument;
+	operations[*length].offset = offset;
+	(*length)++;
+}
+
+/*
+ * Prepares the given evaluation for a run on the cells of the given context.
+ *
+ * @param evaluation The evaluation.
+ * @param context The context the program is evaluated for.
+ */
+static void brainfuck_evaluate_reset(BrainfuckEvaluation *evaluation, BrainfuckExecutionContext *context) {
+	long size = (long) context->tape_size - context->tape_index;
+	free(evaluation->output);
+	memset(evaluation, 0, sizeof(BrainfuckEvaluation));
+	// cells before the first one are never evaluated, so virtual tapes work as well
+	evaluation->size = size < BRAINFUCK_TAPE_SIZE ? size : BRAINFUCK_TAPE_SIZE;
+	evaluation->max = context->cell_bits == 32 ? UINT32_MAX : context->cell_bits == 16 ? UINT16_MAX : UCHAR_MAX;
+	evaluation->wrap = context->cell_wrap != 0;
+}
+
+/*
+ * Executes the part of the given compiled program that does not depend on its
+ * 	input at compile time, starting from a zero tape, until it first reads
+ * 	input, the given amount of operations is executed or it would stop
+ * 	with an error. The evaluated part is replaced by operations that
+ * 	write its output at once and restore the tape it leaves behind, after
+ * 	which the program continues at the last operation outside of any loop
+ * 	that is reached. A program that never reads input is reduced to its
+ * 	output.
+ *
+ * @param program The program to evaluate. Programs that are mapped from the
+ *	cache are left alone.
+ * @param context The context the program is executed with, whose tape must
+ *	still be zero. The result is only valid for contexts with the same
+ *	cells.
+ * @param budget The largest amount of operations that is executed.
+ * @return The amount of operations that are replaced, <code>0</code> if
+ *	nothing could be evaluated or <code>-1</code> on failure.
+ */
+long brainfuck_evaluate(BrainfuckProgram *program, BrainfuckExecutionContext *context, unsigned long budget) {
+	BrainfuckEvaluation *evaluation;
+	BrainfuckEvaluateCheckpoint checkpoint;
+	BrainfuckOperation *operations;
+	BrainfuckPosition *positions = NULL;
+	unsigned char *top;
+	size_t depth = 0;
+	size_t length = 0;
+	size_t capacity;
+	size_t cells = 0;
+	size_t n;
+	size_t run;
+	long cell;
+	if (program == NULL || context == NULL)
+		return -1;
+	if (program->map != NULL || program->length == 0)
+		return 0;
+	top = malloc(program->length);
+	evaluation = calloc(1, sizeof(BrainfuckEvaluation));
+	if (top == NULL || evaluation == NULL) {
+		free(top);
+		free(evaluation);
+		return -1;
+	}
+	brainfuck_evaluate_reset(evaluation, context);
+	// the end of a loop jumps back into it, so only the operation after it is outside
+	for (n = 0; n < program->length; n++) {
+		top[n] = depth == 0;
+		if (program->operations[n].opcode == BRAINFUCK_OP_JUMP_ZERO)
+			depth++;
+		else if (program->operations[n].opcode == BRAINFUCK_OP_JUMP_NONZERO && depth > 0)
+			depth--;
+	}
+
+	/*
+	 * The evaluation may stop inside a loop, in which case it is repeated up to
+	 * 	the last checkpoint to recover the tape at that point.
+	 */
+	checkpoint.counter = 0;
+	checkpoint.steps = 0;
+	checkpoint.output_length = 0;
+	brainfuck_evaluate_run(program, top, evaluation, budget, &checkpoint);
+	if (checkpoint.counter != 0 && checkpoint.steps != evaluation->steps) {
+		brainfuck_evaluate_reset(evaluation, context);
+		brainfuck_evaluate_run(program, top, evaluation, checkpoint.steps, &checkpoint);
+	}
+	free(top);
+	if (checkpoint.counter == 0) {
+		free(evaluation->output);
+		free(evaluation);
+		return 0;
+	}
+
+	// every run of output needs two operations and every cell that is not zero one
+	for (cell = 0; cell < evaluation->high; cell++)
+		cells += evaluation->tape[cell] != 0;
+	capacity = 2 * evaluation->output_length + cells + 2 + program->length - checkpoint.counter;
+	operations = malloc(sizeof(BrainfuckOperation) * capacity);
+	if (program->positions != NULL)
+		positions = calloc(capacity, sizeof(BrainfuckPosition));
+	if (operations == NULL || (program->positions != NULL && positions == NULL)) {
+		free(operations);
+		free(positions);
+		free(evaluation->output);
+		free(evaluation);
+		return -1;
+	}
+	for (n = 0; n < evaluation->output_length; n += run) {
+		for (run = 1; n + run < evaluation->output_length &&
+				evaluation->output[n + run] == evaluation->output[n]; run++)
+			;
+		brainfuck_evaluate_emit(operations, &length, BRAINFUCK_OP_SET,
+				(unsigned char) evaluation->output[n], 0);
+		brainfuck_evaluate_emit(operations, &length, BRAINFUCK_OP_OUTPUT, (int) run, 0);
+	}
+	// the first cell also holds the output, so it is always restored
+	if (evaluation->output_length > 0 && evaluation->tape[0] == 0)
+		brainfuck_evaluate_emit(operations, &length, BRAINFUCK_OP_SET, 0, 0);
+	for (cell = 0; cell < evaluation->high; cell++) {
+		if (evaluation->tape[cell])
+			brainfuck_evaluate_emit(operations, &length, BRAINFUCK_OP_SET,
+					(int) evaluation->tape[cell], (int) cell);
+	}
+	if (evaluation->index != 0)
+		brainfuck_evaluate_emit(operations, &length, BRAINFUCK_OP_MOVE, (int) evaluation->index, 0);
+	if (positions != NULL)
+		memcpy(positions + length, program->positions + checkpoint.counter,
+				sizeof(BrainfuckPosition) * (program->length - checkpoint.counter));
+	memcpy(operations + length, program->operations + checkpoint.counter,
+			sizeof(BrainfuckOperation) * (program->length - checkpoint.counter));
+	length += program->length - checkpoint.counter;
+	free(evaluation->output);
+	free(evaluation);
+
+	free(program->operations);
+	free(program->positions);
+	program->operations = operations;
+	program->positions = positions;
+	program->length = length;
+	brainfuck_validate_program(program);
+	return (long) checkpoint.counter;
+}
@@ -0,0 +1,456 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/brainfuck.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#	define BRAINFUCK_JIT_X86_64 1
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#ifdef BRAINFUCK_JIT_X86_64
+/*
+ * The signature of the generated machine code. It returns the final tape index.
+ */
+typedef long (*BrainfuckJitFunction)(BrainfuckExecutionContext *, char *, long, size_t);
+
+/*
+ * The amount of consecutive I/O calls that are unrolled before a counted
+ * 	loop is emitted instead.
+ */
+#define BRAINFUCK_JIT_UNROLL 4
+
+/*
+ * A growable buffer the machine code is emitted into before it is copied into
+ * 	executable memory.
+ */
+typedef struct BrainfuckJitBuffer {
+	unsigned char *bytes;
+	size_t length;
+	size_t capacity;
+	int failed;
+} BrainfuckJitBuffer;
+
+/*
+ * A jump whose 32-bit displacement is resolved once every operation has been
+ * 	emitted.
+ */
+typedef struct BrainfuckJitFixup {
+	/*
+	 * The position of the displacement in the buffer.
+	 */
+	size_t position;
+	/*
+	 * The index of the operation the jump targets.
+	 */
+	size_t target;
+} BrainfuckJitFixup;
+
+/*
+ * Appends bytes to the given buffer.
+ *
+ * @param buffer The buffer.
+ * @param bytes The bytes to append.
+ * @param length The amount of bytes.
+ */
+static void brainfuck_jit_emit(BrainfuckJitBuffer *buffer, const void *bytes, size_t length) {
+	unsigned char *grown;
+	if (buffer->failed)
+		return;
+	while (buffer->length + length > buffer->capacity) {
+		grown = realloc(buffer->bytes, buffer->capacity * 2);
+		if (grown == NULL) {
+			buffer->failed = 1;
+			return;
+		}
+		buffer->bytes = grown;
+		buffer->capacity *= 2;
+	}
+	memcpy(buffer->bytes + buffer->length, bytes, length);
+	buffer->length += length;
+}
+
+/*
+ * Appends a 32-bit little endian value to the given buffer.
+ *
+ * @param buffer The buffer.
+ * @param value The value.
+ */
+static void brainfuck_jit_emit32(BrainfuckJitBuffer *buffer, int32_t value) {
+	brainfuck_jit_emit(buffer, &value, sizeof(value));
+}
+
+/*
+ * Appends a 64-bit little endian value to the given buffer.
+ *
+ * @param buffer The buffer.
+ * @param value The value.
+ */
+static void brainfuck_jit_emit64(BrainfuckJitBuffer *buffer, uint64_t value) {
+	brainfuck_jit_emit(buffer, &value, sizeof(value));
+}
+
+/*
+ * Emits a 32-bit displacement of a jump to the given position.
+ *
+ * @param buffer The buffer.
+ * @param target The position in the buffer to jump to.
+ */
+static void brainfuck_jit_emit_rel32(BrainfuckJitBuffer *buffer, size_t target) {
+	brainfuck_jit_emit32(buffer, (int32_t) ((long) target - (long) (buffer->length + 4)));
+}
+
+/*
+ * Emits <code>mov rax, imm64; call rax</code>.
+ *
+ * @param buffer The buffer.
+ * @param function The address of the function to call.
+ */
+static void brainfuck_jit_emit_call(BrainfuckJitBuffer *buffer, uint64_t function) {
+	brainfuck_jit_emit(buffer, "\x48\xB8", 2);
+	brainfuck_jit_emit64(buffer, function);
+	brainfuck_jit_emit(buffer, "\xFF\xD0", 2);
+}
+
+/*
+ * Emits a check that terminates the program when the cell at the given
+ * 	offset is out of bounds. The check is omitted for the current cell,
+ * 	which is always in bounds.
+ *
+ * @param buffer The buffer.
+ * @param offset The offset of the cell.
+ * @param error The position of the code that reports an index in rax.
+ */
+static void brainfuck_jit_emit_check(BrainfuckJitBuffer *buffer, int offset, size_t error) {
+	if (offset == 0)
+		return;
+	brainfuck_jit_emit(buffer, "\x49\x8D\x84\x24", 4); // lea rax, [r12 + offset]
+	brainfuck_jit_emit32(buffer, offset);
+	brainfuck_jit_emit(buffer, "\x4C\x39\xE8", 3); // cmp rax, r13
+	brainfuck_jit_emit(buffer, "\x0F\x83", 2); // jae error
+	brainfuck_jit_emit_rel32(buffer, error);
+}
+
+/*
+ * Emits the calls of an output or input operation. A run of output is passed
+ * 	to <code>brainfuck_output</code> at once, while input is read one
+ * 	character at a time.
+ *
+ * @param buffer The buffer.
+ * @param operation The output or input operation.
+ */
+static void brainfuck_jit_emit_io(BrainfuckJitBuffer *buffer, const BrainfuckOperation *operation) {
+	int i;
+	int count = operation->argument > BRAINFUCK_JIT_UNROLL ? 1 : operation->argument;
+	size_t loop = 0;
+	if (operation->opcode == BRAINFUCK_OP_OUTPUT) {
+		brainfuck_jit_emit(buffer, "\x4C\x89\xF7", 3); // mov rdi, r14
+		brainfuck_jit_emit(buffer, "\x42\x0F\xBE\xB4\x23", 5); // movsx esi, byte [rbx + r12 + offset]
+		brainfuck_jit_emit32(buffer, operation->offset);
+		brainfuck_jit_emit(buffer, "\xBA", 1); // mov edx, count
+		brainfuck_jit_emit32(buffer, operation->argument);
+		brainfuck_jit_emit_call(buffer, (uint64_t) (uintptr_t) &brainfuck_output);
+		return;
+	}
+	if (operation->argument > BRAINFUCK_JIT_UNROLL) {
+		brainfuck_jit_emit(buffer, "\x41\xBF", 2); // mov r15d, count
+		brainfuck_jit_emit32(buffer, operation->argument);
+		loop = buffer->length;
+	}
+	for (i = 0; i < count; i++) {
+		brainfuck_jit_emit(buffer, "\x4C\x89\xF7", 3); // mov rdi, r14
+		brainfuck_jit_emit(buffer, "\x42\x0F\xBE\xB4\x23", 5); // movsx esi, byte [rbx + r12 + offset]
+		brainfuck_jit_emit32(buffer, operation->offset);
+		brainfuck_jit_emit_call(buffer, (uint64_t) (uintptr_t) &brainfuck_input);
+		brainfuck_jit_emit(buffer, "\x42\x88\x84\x23", 4); // mov [rbx + r12 + offset], al
+		brainfuck_jit_emit32(buffer, operation->offset);
+	}
+	if (operation->argument > BRAINFUCK_JIT_UNROLL) {
+		brainfuck_jit_emit(buffer, "\x41\xFF\xCF", 3); // dec r15d
+		brainfuck_jit_emit(buffer, "\x0F\x85", 2); // jnz loop
+		brainfuck_jit_emit_rel32(buffer, loop);
+	}
+}
+
+/*
+ * Translates the given compiled program into x86-64 machine code.
+ *
+ * @param program The compiled program.
+ * @param buffer The buffer to emit the machine code into.
+ * @return The position of the entry point in the buffer.
+ */
+static size_t brainfuck_jit_translate(BrainfuckProgram *program, BrainfuckJitBuffer *buffer) {
+	size_t *positions = malloc(sizeof(size_t) * (program->length + 1));
+	// a closing jump needs two fixups, one to leave the loop and one to repeat it
+	BrainfuckJitFixup *fixups = malloc(sizeof(BrainfuckJitFixup) * (program->length * 2 + 1));
+	size_t fixup_count = 0;
+	size_t n;
+	size_t error_r12, error, exit, entry;
+	int32_t displacement;
+	const BrainfuckOperation *operation;
+	if (positions == NULL || fixups == NULL) {
+		free(positions);
+		free(fixups);
+		buffer->failed = 1;
+		return 0;
+	}
+
+	/*
+	 * The error and exit paths come first, so that every jump to them is a
+	 * 	backward jump with a known displacement.
+	 */
+	error_r12 = buffer->length;
+	brainfuck_jit_emit(buffer, "\x4C\x89\xE0", 3); // mov rax, r12
+	error = buffer->length;
+	brainfuck_jit_emit(buffer, "\x4C\x89\xF7", 3); // mov rdi, r14
+	brainfuck_jit_emit(buffer, "\x48\x89\xC6", 3); // mov rsi, rax
+	brainfuck_jit_emit_call(buffer, (uint64_t) (uintptr_t) &brainfuck_out_of_bounds);
+	brainfuck_jit_emit(buffer, "\x0F\x0B", 2); // ud2
+	exit = buffer->length;
+	brainfuck_jit_emit(buffer, "\x4C\x89\xE0", 3); // mov rax, r12
+	brainfuck_jit_emit(buffer, "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5B\xC3", 10); // pop r15 ... rbx; ret
+
+	/*
+	 * rbx holds the tape, r12 the tape index, r13 the tape size and r14 the
+	 * 	context. Five pushes keep the stack aligned for calls.
+	 */
+	entry = buffer->length;
+	brainfuck_jit_emit(buffer, "\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9); // push rbx ... r15
+	brainfuck_jit_emit(buffer, "\x49\x89\xFE", 3); // mov r14, rdi
+	brainfuck_jit_emit(buffer, "\x48\x89\xF3", 3); // mov rbx, rsi
+	brainfuck_jit_emit(buffer, "\x49\x89\xD4", 3); // mov r12, rdx
+	brainfuck_jit_emit(buffer, "\x49\x89\xCD", 3); // mov r13, rcx
+
+	for (n = 0; n < program->length; n++) {
+		operation = &program->operations[n];
+		positions[n] = buffer->length;
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+			brainfuck_jit_emit_check(buffer, operation->offset, error);
+			brainfuck_jit_emit(buffer, "\x42\x80\x84\x23", 4); // add byte [rbx + r12 + offset], imm8
+			brainfuck_jit_emit32(buffer, operation->offset);
+			brainfuck_jit_emit(buffer, &(unsigned char) { (unsigned char) operation->argument }, 1);
+			break;
+		case BRAINFUCK_OP_SET:
+			brainfuck_jit_emit_check(buffer, operation->offset, error);
+			brainfuck_jit_emit(buffer, "\x42\xC6\x84\x23", 4); // mov byte [rbx + r12 + offset], imm8
+			brainfuck_jit_emit32(buffer, operation->offset);
+			brainfuck_jit_emit(buffer, &(unsigned char) { (unsigned char) operation->argument }, 1);
+			break;
+		case BRAINFUCK_OP_MUL:
+			brainfuck_jit_emit(buffer, "\x42\x0F\xB6\x0C\x23", 5); // movzx ecx, byte [rbx + r12]
+			brainfuck_jit_emit(buffer, "\x84\xC9", 2); // test cl, cl
+			brainfuck_jit_emit(buffer, "\x0F\x84", 2); // jz next
+			fixups[fixup_count].position = buffer->length;
+			fixups[fixup_count++].target = n + 1;
+			brainfuck_jit_emit32(buffer, 0);
+			brainfuck_jit_emit_check(buffer, operation->offset, error);
+			brainfuck_jit_emit(buffer, "\x69\xC9", 2); // imul ecx, ecx, factor
+			brainfuck_jit_emit32(buffer, operation->argument);
+			brainfuck_jit_emit(buffer, "\x42\x00\x8C\x23", 4); // add [rbx + r12 + offset], cl
+			brainfuck_jit_emit32(buffer, operation->offset);
+			break;
+		case BRAINFUCK_OP_SCAN:
+			brainfuck_jit_emit(buffer, "\x48\x89\xDF", 3); // mov rdi, rbx
+			brainfuck_jit_emit(buffer, "\x4C\x89\xEE", 3); // mov rsi, r13
+			brainfuck_jit_emit(buffer, "\x4C\x89\xE2", 3); // mov rdx, r12
+			brainfuck_jit_emit(buffer, "\x48\xC7\xC1", 3); // mov rcx, stride
+			brainfuck_jit_emit32(buffer, operation->argument);
+			brainfuck_jit_emit_call(buffer, (uint64_t) (uintptr_t) &brainfuck_scan);
+			brainfuck_jit_emit(buffer, "\x49\x89\xC4", 3); // mov r12, rax
+			brainfuck_jit_emit(buffer, "\x4D\x39\xEC", 3); // cmp r12, r13
+			brainfuck_jit_emit(buffer, "\x0F\x83", 2); // jae error
+			brainfuck_jit_emit_rel32(buffer, error_r12);
+			break;
+		case BRAINFUCK_OP_MOVE:
+			brainfuck_jit_emit(buffer, "\x49\x81\xC4", 3); // add r12, distance
+			brainfuck_jit_emit32(buffer, operation->argument);
+			brainfuck_jit_emit(buffer, "\x4D\x39\xEC", 3); // cmp r12, r13
+			brainfuck_jit_emit(buffer, "\x0F\x83", 2); // jae error
+			brainfuck_jit_emit_rel32(buffer, error_r12);
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+			brainfuck_jit_emit_check(buffer, operation->offset, error);
+			brainfuck_jit_emit_io(buffer, operation);
+			break;
+		case BRAINFUCK_OP_INPUT:
+			brainfuck_jit_emit_check(buffer, operation->offset, error);
+			brainfuck_jit_emit_io(buffer, operation);
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+			brainfuck_jit_emit(buffer, "\x42\x80\x3C\x23\x00", 5); // cmp byte [rbx + r12], 0
+			brainfuck_jit_emit(buffer, "\x0F\x84", 2); // je after the loop
+			fixups[fixup_count].position = buffer->length;
+			fixups[fixup_count++].target = n + operation->argument + 1;
+			brainfuck_jit_emit32(buffer, 0);
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			brainfuck_jit_emit(buffer, "\x42\x80\x3C\x23\x00", 5); // cmp byte [rbx + r12], 0
+			brainfuck_jit_emit(buffer, "\x0F\x84", 2); // je next
+			fixups[fixup_count].position = buffer->length;
+			fixups[fixup_count++].target = n + 1;
+			brainfuck_jit_emit32(buffer, 0);
+			// only poll the stop flag on backward jumps
+			brainfuck_jit_emit(buffer, "\x41\x83\xBE", 3); // cmp dword [r14 + shouldStop], 1
+			brainfuck_jit_emit32(buffer, offsetof(BrainfuckExecutionContext, shouldStop));
+			brainfuck_jit_emit(buffer, "\x01\x0F\x84", 3); // je exit
+			brainfuck_jit_emit_rel32(buffer, exit);
+			brainfuck_jit_emit(buffer, "\xE9", 1); // jmp loop body
+			fixups[fixup_count].position = buffer->length;
+			fixups[fixup_count++].target = n - operation->argument + 1;
+			brainfuck_jit_emit32(buffer, 0);
+			break;
+		default:
+			brainfuck_jit_emit(buffer, "\xE9", 1); // jmp exit
+			brainfuck_jit_emit_rel32(buffer, exit);
+			break;
+		}
+	}
+	positions[n] = buffer->length;
+	brainfuck_jit_emit(buffer, "\xE9", 1); // jmp exit
+	brainfuck_jit_emit_rel32(buffer, exit);
+
+	for (n = 0; n < fixup_count && !buffer->failed; n++) {
+		displacement = (int32_t) ((long) positions[fixups[n].target] - (long) (fixups[n].position + 4));
+		memcpy(buffer->bytes + fixups[n].position, &displacement, sizeof(displacement));
+	}
+	free(positions);
+	free(fixups);
+	return entry;
+}
+#endif
+
+/*
+ * Translates the given linked list containing instructions into native
+ * 	machine code. Only x86-64 is supported; on other architectures this
+ * 	function returns <code>NULL</code> and the program should be executed
+ * 	by the interpreter instead.
+ *
+ * @param root The start of the linked list of instructions you want to compile.
+ * @return The compiled program or <code>NULL</code> if it could not be compiled.
+ */
+BrainfuckJitProgram * brainfuck_jit_compile(BrainfuckInstruction *root) {
+#ifdef BRAINFUCK_JIT_X86_64
+	BrainfuckProgram *program = brainfuck_compile(root);
+	BrainfuckJitProgram *jit = brainfuck_jit_compile_program(program);
+	brainfuck_destroy_program(program);
+	return jit;
+#else
+	(void) root;
+	return NULL;
+#endif
+}
+
+/*
+ * Translates the given compiled program into native machine code, like
+ * 	<code>brainfuck_jit_compile</code>.
+ *
+ * @param program The compiled program you want to translate.
+ * @return The translated program or <code>NULL</code> if it could not be
+ *	translated.
+ */
+BrainfuckJitProgram * brainfuck_jit_compile_program(BrainfuckProgram *program) {
+#ifdef BRAINFUCK_JIT_X86_64
+	BrainfuckJitProgram *jit;
+	BrainfuckJitBuffer buffer;
+	size_t entry;
+	void *memory;
+	long page = sysconf(_SC_PAGESIZE);
+	if (program == NULL)
+		return NULL;
+	buffer.capacity = 4096;
+	buffer.length = 0;
+	buffer.failed = 0;
+	buffer.bytes = malloc(buffer.capacity);
+	if (buffer.bytes == NULL)
+		return NULL;
+	entry = brainfuck_jit_translate(program, &buffer);
+	jit = (BrainfuckJitProgram *) malloc(sizeof(BrainfuckJitProgram));
+	if (buffer.failed || jit == NULL) {
+		free(buffer.bytes);
+		free(jit);
+		return NULL;
+	}
+
+	/*
+	 * The code is written while the memory is writable and only then made
+	 * 	executable, so the memory is never writable and executable at once.
+	 */
+	jit->size = (buffer.length + page - 1) / page * page;
+	memory = mmap(NULL, jit->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		free(buffer.bytes);
+		free(jit);
+		return NULL;
+	}
+	memcpy(memory, buffer.bytes, buffer.length);
+	free(buffer.bytes);
+	if (mprotect(memory, jit->size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, jit->size);
+		free(jit);
+		return NULL;
+	}
+	jit->code = memory;
+	jit->entry = (char *) memory + entry;
+	return jit;
+#else
+	(void) program;
+	return NULL;
+#endif
+}
+
+/*
+ * Executes the given natively compiled program.
+ *
+ * @param program The program you want to execute.
+ * @param context The context of this execution that contains the tape and
+ *	other execution related variables.
+ */
+void brainfuck_jit_run(BrainfuckJitProgram *program, BrainfuckExecutionContext *context) {
+#ifdef BRAINFUCK_JIT_X86_64
+	BrainfuckJitFunction function;
+	if (program == NULL || context == NULL)
+		return;
+	*(void **) &function = program->entry;
+	context->tape_index = function(context, context->tape, context->tape_index, context->tape_size);
+	brainfuck_flush(context);
+#else
+	(void) program;
+	(void) context;
+#endif
+}
+
+/*
+ * Destroys a natively compiled program.
+ *
+ * @param program The program to destroy.
+ */
+void brainfuck_destroy_jit(BrainfuckJitProgram *program) {
+	if (program == NULL)
+		return;
+#ifdef BRAINFUCK_JIT_X86_64
+	munmap(program->code, program->size);
+#endif
+	free(program);
+	program = 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The loops over the lanes have a constant trip count and no branches, so the
+ * 	compiler turns each of them into a few vector instructions. Lanes that
+ * 	are not active are masked out of every write, which keeps the tape of
+ * 	a parked lane as it was when it stopped.
+ */
+#define BRAINFUCK_LANES_EACH(lane) for (lane = 0; lane < BRAINFUCK_LANES; lane++)
+
+/*
+ * Appends a character to the output of a lane.
+ *
+ * @param lane The lane.
+ * @param chr The character.
+ * @param count The amount of times to append it.
+ * @return <code>0</code> on success, <code>-1</code> if the output could not
+ *	grow.
+ */
+static int brainfuck_lanes_output(BrainfuckLane *lane, char chr, size_t count) {
+	size_t capacity = lane->output_capacity;
+	char *grown;
+	if (lane->output_length + count > capacity) {
+		while (lane->output_length + count > capacity)
+			capacity = capacity == 0 ? BRAINFUCK_OUTPUT_BUFFER_SIZE : capacity * 2;
+		grown = realloc(lane->output, capacity);
+		if (grown == NULL)
+			return -1;
+		lane->output = grown;
+		lane->output_capacity = capacity;
+	}
+	memset(lane->output + lane->output_length, chr, count);
+	lane->output_length += count;
+	return 0;
+}
+
+/*
+ * Stops a lane at the given operation and tape index.
+ *
+ * @param lanes The lanes.
+ * @param active The masks of the lanes that are still running.
+ * @param lane The index of the lane.
+ * @param counter The index of the operation.
+ * @param index The tape index.
+ */
+static void brainfuck_lanes_park(BrainfuckLanes *lanes, unsigned char *active, int lane, size_t counter, long index) {
+	lanes->lanes[lane].parked = 1;
+	lanes->lanes[lane].program_counter = counter;
+	lanes->lanes[lane].tape_index = index;
+	active[lane] = 0;
+}
+
+/*
+ * Stops the lanes whose current cell is zero, or those whose current cell is
+ * 	not, at the given operation.
+ *
+ * @param lanes The lanes.
+ * @param active The masks of the lanes that are still running.
+ * @param cell The current cells.
+ * @param zero Whether to stop the lanes whose cell is zero.
+ * @param counter The index of the operation.
+ * @param index The tape index.
+ */
+static void brainfuck_lanes_split(BrainfuckLanes *lanes, unsigned char *active, const unsigned char *cell, int zero,
+		size_t counter, long index) {
+	int lane;
+	BRAINFUCK_LANES_EACH(lane) {
+		if (active[lane] && (cell[lane] == 0) == zero)
+			brainfuck_lanes_park(lanes, active, lane, counter, index);
+	}
+}
+
+/*
+ * Creates the lanes to run programs in lockstep with.
+ *
+ * @param size The size of the tape of every lane in cells.
+ * @return The lanes or <code>NULL</code> if they could not be allocated.
+ */
+BrainfuckLanes * brainfuck_lanes(size_t size) {
+	BrainfuckLanes *lanes = calloc(1, sizeof(BrainfuckLanes));
+	if (lanes == NULL)
+		return NULL;
+	lanes->tape = calloc(size, BRAINFUCK_LANES);
+	if (lanes->tape == NULL) {
+		free(lanes);
+		return NULL;
+	}
+	lanes->size = size;
+	return lanes;
+}
+
+/*
+ * Runs the given program over the inputs of the lanes at once.
+ *
+ * @param lanes The lanes, whose inputs are set.
+ * @param program The program.
+ * @param context The context whose tape index and end of input behavior are
+ *	used.
+ * @return <code>0</code> on success, <code>-1</code> if the cells of the
+ *	context are not supported or output could not be allocated.
+ */
+int brainfuck_lanes_run(BrainfuckLanes *lanes, BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	const BrainfuckOperation *operation;
+	unsigned char active[BRAINFUCK_LANES];
+	unsigned char *tape;
+	unsigned char *cell;
+	unsigned char *cells;
+	unsigned char argument;
+	const size_t size = lanes != NULL ? lanes->size : 0;
+	long index;
+	long target;
+	long low;
+	long high;
+	size_t counter;
+	int running;
+	int count;
+	int lane;
+	int i;
+	if (lanes == NULL || program == NULL || context == NULL || context->cell_bits != 8 || !context->cell_wrap ||
+			(size_t) context->tape_size != size || (unsigned long) context->tape_index >= size)
+		return -1;
+	tape = lanes->tape;
+	// only the cells the previous run may have reached are cleared
+	if (lanes->high > lanes->low)
+		memset(tape + lanes->low * BRAINFUCK_LANES, 0, (lanes->high - lanes->low) * BRAINFUCK_LANES);
+	index = context->tape_index;
+	low = high = index;
+	BRAINFUCK_LANES_EACH(lane) {
+		active[lane] = lane < lanes->count ? 0xff : 0;
+		lanes->lanes[lane].input_position = 0;
+		lanes->lanes[lane].output_length = 0;
+		lanes->lanes[lane].parked = 0;
+	}
+	running = lanes->count > 0;
+	for (operation = program->operations; running; operation++) {
+		counter = (size_t) (operation - program->operations);
+		cell = tape + index * BRAINFUCK_LANES;
+		cells = cell;
+		argument = (unsigned char) operation->argument;
+		// the lanes do not report errors, so a lane that would leave the tape stops before
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+		case BRAINFUCK_OP_SET:
+		case BRAINFUCK_OP_MUL:
+		case BRAINFUCK_OP_OUTPUT:
+		case BRAINFUCK_OP_INPUT:
+			target = index + operation->offset;
+			if ((unsigned long) target < size) {
+				cells = tape + target * BRAINFUCK_LANES;
+				break;
+			}
+			BRAINFUCK_LANES_EACH(lane) {
+				if (active[lane])
+					brainfuck_lanes_park(lanes, active, lane, counter, index);
+			}
+			running = 0;
+			continue;
+		}
+		switch (operation->opcode) {
+		case BRAINFUCK_OP_ADD:
+			BRAINFUCK_LANES_EACH(lane)
+				cells[lane] += argument & active[lane];
+			break;
+		case BRAINFUCK_OP_SET:
+			BRAINFUCK_LANES_EACH(lane)
+				cells[lane] = (cells[lane] & ~active[lane]) | (argument & active[lane]);
+			break;
+		case BRAINFUCK_OP_MUL:
+			BRAINFUCK_LANES_EACH(lane)
+				cells[lane] += (unsigned char) (cell[lane] * argument) & active[lane];
+			break;
+		case BRAINFUCK_OP_SCAN:
+			/*
+			 * The lanes keep together as long as they stop at the same cell, so
+			 * 	the lanes that stop elsewhere than the first one are parked.
+			 */
+			target = -1;
+			BRAINFUCK_LANES_EACH(lane) {
+				long stop = index;
+				if (!active[lane])
+					continue;
+				while ((unsigned long) stop < size && tape[stop * BRAINFUCK_LANES + lane] != 0)
+					stop += operation->argument;
+				if (target < 0 && (unsigned long) stop < size)
+					target = stop;
+				if (stop != target || target < 0)
+					brainfuck_lanes_park(lanes, active, lane, counter, index);
+			}
+			if (target < 0) {
+				running = 0;
+				break;
+			}
+			index = target;
+			low = index < low ? index : low;
+			high = index > high ? index : high;
+			break;
+		case BRAINFUCK_OP_MOVE:
+			target = index + operation->argument;
+			if ((unsigned long) target >= size) {
+				BRAINFUCK_LANES_EACH(lane) {
+					if (active[lane])
+						brainfuck_lanes_park(lanes, active, lane, counter, index);
+				}
+				running = 0;
+				break;
+			}
+			index = target;
+			low = index < low ? index : low;
+			high = index > high ? index : high;
+			break;
+		case BRAINFUCK_OP_OUTPUT:
+			BRAINFUCK_LANES_EACH(lane) {
+				if (active[lane] && brainfuck_lanes_output(&lanes->lanes[lane], (char) cells[lane],
+						(size_t) operation->argument) < 0)
+					return -1;
+			}
+			break;
+		case BRAINFUCK_OP_INPUT:
+			BRAINFUCK_LANES_EACH(lane) {
+				BrainfuckLane *input = &lanes->lanes[lane];
+				if (!active[lane])
+					continue;
+				for (i = 0; i < operation->argument; i++) {
+					if (input->input_position < input->input_length)
+						cells[lane] = (unsigned char) input->input[input->input_position++];
+					else if (context->eof_behavior == BRAINFUCK_EOF_ZERO)
+						cells[lane] = 0;
+					else if (context->eof_behavior == BRAINFUCK_EOF_MINUS_ONE)
+						cells[lane] = 0xff;
+				}
+			}
+			break;
+		case BRAINFUCK_OP_JUMP_ZERO:
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			count = 0;
+			running = 0;
+			BRAINFUCK_LANES_EACH(lane) {
+				count += (cell[lane] == 0) & active[lane] & 1;
+				running += active[lane] & 1;
+			}
+			// lanes that disagree with the majority continue on their own
+			if (count > 0 && count < running) {
+				brainfuck_lanes_split(lanes, active, cell, count * 2 < running, counter, index);
+				count = count * 2 < running ? 0 : running;
+			}
+			if (operation->opcode == BRAINFUCK_OP_JUMP_ZERO && count > 0)
+				operation += operation->argument;
+			else if (operation->opcode == BRAINFUCK_OP_JUMP_NONZERO && count == 0)
+				operation -= operation->argument;
+			break;
+		default:
+			running = 0;
+			continue;
+		}
+		if (operation->opcode == BRAINFUCK_OP_SCAN || operation->opcode == BRAINFUCK_OP_JUMP_ZERO ||
+				operation->opcode == BRAINFUCK_OP_JUMP_NONZERO) {
+			running = 0;
+			BRAINFUCK_LANES_EACH(lane)
+				running += active[lane] & 1;
+			// once most lanes are parked, the rest run faster on their own than masked
+			if (running * 2 < lanes->count) {
+				BRAINFUCK_LANES_EACH(lane) {
+					if (active[lane])
+						brainfuck_lanes_park(lanes, active, lane,
+							(size_t) (operation + 1 - program->operations), index);
+				}
+				running = 0;
+			}
+		}
+	}
+	// cells beyond the tape index are reached through the offsets of the operations
+	low -= (long) program->reach;
+	high += (long) program->reach + 1;
+	lanes->low = low < 0 ? 0 : (size_t) low;
+	lanes->high = (size_t) high > size ? size : (size_t) high;
+	return 0;
+}
+
+/*
+ * Moves a parked lane into the given context.
+ *
+ * @param lanes The lanes.
+ * @param lane The index of the lane, which must be parked.
+ * @param context The context, whose tape must be zero.
+ * @return <code>0</code> on success, <code>-1</code> if the lane is not
+ *	parked or the context does not fit.
+ */
+int brainfuck_lanes_resume(BrainfuckLanes *lanes, int lane, BrainfuckExecutionContext *context) {
+	BrainfuckLane *parked;
+	unsigned char *tape;
+	size_t n;
+	if (lanes == NULL || context == NULL || lane < 0 || lane >= lanes->count || !lanes->lanes[lane].parked ||
+			context->cell_bits != 8 || (size_t) context->tape_size != lanes->size)
+		return -1;
+	parked = &lanes->lanes[lane];
+	tape = (unsigned char *) context->tape;
+	for (n = lanes->low; n < lanes->high; n++)
+		tape[n] = lanes->tape[n * BRAINFUCK_LANES + lane];
+	context->tape_index = (int) parked->tape_index;
+	context->program_counter = parked->program_counter;
+	context->input_pending = 0;
+	brainfuck_set_input(context, parked->input, parked->input_length);
+	context->input_position = parked->input_position;
+	return 0;
+}
+
+/*
+ * Destroys lanes and the outputs of their lanes.
+ *
+ * @param lanes The lanes to destroy.
+ */
+void brainfuck_destroy_lanes(BrainfuckLanes *lanes) {
+	int lane;
+	if (lanes == NULL)
+		return;
+	BRAINFUCK_LANES_EACH(lane)
+		free(lanes->lanes[lane].output);
+	free(lanes->tape);
+	free(lanes);
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_LOAD_MMAP 1
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && \
+		(defined(__GNUC__) || defined(__clang__))
+#	define BRAINFUCK_LOAD_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+#include "../include/brainfuck.h"
+
+/*
+ * The amount of bytes that are read at once from streams that can not be
+ * 	mapped into memory.
+ */
+#define BRAINFUCK_LOAD_CHUNK 65536
+
+/*
+ * The amount of nested loops the loader makes room for at first.
+ */
+#define BRAINFUCK_LOAD_DEPTH 64
+
+/*
+ * Marks the bytes that are commands; every other byte is a comment.
+ */
+static const unsigned char brainfuck_load_commands[256] = {
+	[BRAINFUCK_TOKEN_PLUS] = 1,
+	[BRAINFUCK_TOKEN_MINUS] = 1,
+	[BRAINFUCK_TOKEN_PREVIOUS] = 1,
+	[BRAINFUCK_TOKEN_NEXT] = 1,
+	[BRAINFUCK_TOKEN_OUTPUT] = 1,
+	[BRAINFUCK_TOKEN_INPUT] = 1,
+	[BRAINFUCK_TOKEN_LOOP_START] = 1,
+	[BRAINFUCK_TOKEN_LOOP_END] = 1
+};
+
+/*
+ * A loop that is opened, but not yet closed.
+ */
+typedef struct BrainfuckLoadLoop {
+	/*
+	 * The instruction that starts the loop.
+	 */
+	BrainfuckInstruction *instruction;
+	/*
+	 * The position of the '[' in the source.
+	 */
+	size_t position;
+} BrainfuckLoadLoop;
+
+/*
+ * Tracks the line of the command the loader is at. Commands are visited in
+ * 	order, so only the newlines since the previous command are counted.
+ */
+typedef struct BrainfuckLoadCursor {
+	/*
+	 * The position up to which newlines are counted.
+	 */
+	size_t position;
+	/*
+	 * The line at <code>position</code>, counted from 1.
+	 */
+	size_t line;
+	/*
+	 * The position at which that line starts.
+	 */
+	size_t start;
+} BrainfuckLoadCursor;
+
+/*
+ * Records the line and column of the command at the given position of the
+ * 	source in the given instruction.
+ *
+ * @param cursor The cursor, which is moved to the position.
+ * @param instruction The instruction.
+ * @param source The source.
+ * @param position The position of the command.
+ */
+static void brainfuck_load_locate(BrainfuckLoadCursor *cursor, BrainfuckInstruction *instruction,
+		const char *source, size_t position) {
+	const char *newline;
+	while (cursor->position < position &&
+			(newline = memchr(source + cursor->position, '\n', position - cursor->position)) != NULL) {
+		cursor->position = (size_t) (newline - source) + 1;
+		cursor->start = cursor->position;
+		cursor->line++;
+	}
+	cursor->position = position;
+	instruction->line = (unsigned int) cursor->line;
+	instruction->column = (unsigned int) (position - cursor->start + 1);
+}
+
+/*
+ * Finds the next command in the given source, skipping comments sixteen
+ * 	bytes at a time where possible.
+ *
+ * @param source The source.
+ * @param position The position to start at.
+ * @param length The length of the source.
+ * @return The position of the next command or <code>length</code> if there
+ *	is none.
+ */
+static size_t brainfuck_load_skip(const char *source, size_t position, size_t length) {
+	if (position < length && brainfuck_load_commands[(unsigned char) source[position]])
+		return position;
+#ifdef BRAINFUCK_LOAD_SSE2
+	const __m128i plus = _mm_set1_epi8(BRAINFUCK_TOKEN_PLUS);
+	const __m128i three = _mm_set1_epi8(3);
+	const __m128i two = _mm_set1_epi8(2);
+	const __m128i next = _mm_set1_epi8(BRAINFUCK_TOKEN_NEXT);
+	const __m128i start = _mm_set1_epi8(BRAINFUCK_TOKEN_LOOP_START);
+	const __m128i end = _mm_set1_epi8(BRAINFUCK_TOKEN_LOOP_END);
+	__m128i bytes, found;
+	unsigned int bits;
+	while (position + 16 <= length) {
+		bytes = _mm_loadu_si128((const __m128i *) (source + position));
+		// '+', ',', '-' and '.' are adjacent, '<' and '>' differ in a single bit
+		found = _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8(bytes, plus), three),
+				_mm_sub_epi8(bytes, plus));
+		found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_or_si128(bytes, two), next));
+		found = _mm_or_si128(found, _mm_cmpeq_epi8(bytes, start));
+		found = _mm_or_si128(found, _mm_cmpeq_epi8(bytes, end));
+		bits = (unsigned int) _mm_movemask_epi8(found);
+		if (bits)
+			return position + __builtin_ctz(bits);
+		position += 16;
+	}
+#endif
+	while (position < length && !brainfuck_load_commands[(unsigned char) source[position]])
+		position++;
+	return position;
+}
+
+/*
+ * Reports a bracket that has no match.
+ *
+ * @param state The state the source is parsed into.
+ * @param source The source.
+ * @param position The position of the bracket.
+ */
+static void brainfuck_load_unmatched(BrainfuckState *state, const char *source, size_t position) {
+	char message[128];
+	size_t line = 1;
+	size_t column = 1;
+	size_t index;
+	for (index = 0; index < position; index++) {
+		if (source[index] == '\n') {
+			line++;
+			column = 1;
+		} else {
+			column++;
+		}
+	}
+	snprintf(message, sizeof(message), "error: unmatched '%c' at line %zu, column %zu\n",
+			source[position], line, column);
+	if (state->report_handler != NULL)
+		state->report_handler(message, strlen(message));
+	else
+		fputs(message, stderr);
+}
+
+/*
+ * Converts the given source into instructions in a single pass and adds them to
+ * 	the given state. Runs of commands are merged even when they are
+ * 	interrupted by comments. The instructions are allocated from the arena
+ * 	of the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param source The source to parse.
+ * @param length The length of the source.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if a bracket has no match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_buffer(BrainfuckState *state, const char *source, size_t length) {
+	BrainfuckLoadLoop *loops;
+	BrainfuckLoadLoop *grown;
+	size_t capacity = BRAINFUCK_LOAD_DEPTH;
+	size_t depth = 0;
+	size_t position;
+	size_t next;
+	long amount;
+	char c;
+	BrainfuckLoadCursor cursor = { 0, 1, 0 };
+	if (state == NULL || (source == NULL && length > 0))
+		return NULL;
+	loops = malloc(sizeof(BrainfuckLoadLoop) * capacity);
+	if (loops == NULL)
+		return NULL;
+	BrainfuckInstruction *root = brainfuck_allocate_instruction(state);
+	BrainfuckInstruction *instruction = root;
+	for (position = brainfuck_load_skip(source, 0, length); position < length;
+			position = brainfuck_load_skip(source, position + 1, length)) {
+		c = source[position];
+		brainfuck_load_locate(&cursor, instruction, source, position);
+		switch (c) {
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			amount = 0;
+			next = position;
+			do {
+				position = next;
+				switch (source[position]) {
+				case BRAINFUCK_TOKEN_PLUS:
+				case BRAINFUCK_TOKEN_NEXT:
+					amount++;
+					break;
+				default:
+					amount--;
+				}
+				next = brainfuck_load_skip(source, position + 1, length);
+			} while (next < length && (c == BRAINFUCK_TOKEN_PLUS || c == BRAINFUCK_TOKEN_MINUS ?
+					source[next] == BRAINFUCK_TOKEN_PLUS || source[next] == BRAINFUCK_TOKEN_MINUS :
+					source[next] == BRAINFUCK_TOKEN_NEXT || source[next] == BRAINFUCK_TOKEN_PREVIOUS));
+			if (c == BRAINFUCK_TOKEN_PLUS || c == BRAINFUCK_TOKEN_MINUS)
+				instruction->type = amount < 0 ? BRAINFUCK_TOKEN_MINUS : BRAINFUCK_TOKEN_PLUS;
+			else
+				instruction->type = amount < 0 ? BRAINFUCK_TOKEN_PREVIOUS : BRAINFUCK_TOKEN_NEXT;
+			instruction->difference = (unsigned long) (amount < 0 ? -amount : amount);
+			break;
+		case BRAINFUCK_TOKEN_OUTPUT:
+		case BRAINFUCK_TOKEN_INPUT:
+			instruction->type = c;
+			instruction->difference = 1;
+			while ((next = brainfuck_load_skip(source, position + 1, length)) < length && source[next] == c) {
+				instruction->difference++;
+				position = next;
+			}
+			break;
+		case BRAINFUCK_TOKEN_LOOP_START:
+			if (depth == capacity) {
+				grown = realloc(loops, sizeof(BrainfuckLoadLoop) * capacity * 2);
+				if (grown == NULL) {
+					free(loops);
+					return NULL;
+				}
+				loops = grown;
+				capacity *= 2;
+			}
+			instruction->type = c;
+			instruction->difference = 1;
+			instruction->loop = brainfuck_allocate_instruction(state);
+			loops[depth].instruction = instruction;
+			loops[depth++].position = position;
+			instruction = instruction->loop;
+			continue;
+		default:
+			if (depth == 0) {
+				brainfuck_load_unmatched(state, source, position);
+				free(loops);
+				return NULL;
+			}
+			// terminate the body and continue after the loop
+			instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+			instruction = loops[--depth].instruction;
+			break;
+		}
+		instruction->next = brainfuck_allocate_instruction(state);
+		instruction->next->previous = instruction;
+		instruction = instruction->next;
+	}
+	if (depth > 0) {
+		brainfuck_load_unmatched(state, source, loops[depth - 1].position);
+		free(loops);
+		return NULL;
+	}
+	free(loops);
+	brainfuck_load_locate(&cursor, instruction, source, length);
+	instruction->type = BRAINFUCK_TOKEN_LOOP_END;
+	brainfuck_add(state, root);
+	return root;
+}
+
+/*
+ * Reads instructions from the given string and adds them to the given state.
+ * 	The instructions are allocated from the arena of the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param str The string to read from.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if a bracket has no match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_string(BrainfuckState *state, char *str) {
+	if (state == NULL || str == NULL)
+		return NULL;
+	return brainfuck_state_parse_buffer(state, str, strlen(str));
+}
+
+/*
+ * Reads the whole given stream into memory. Regular files are mapped into
+ * 	memory, other streams are read in large chunks.
+ *
+ * @param stream The stream to read from.
+ * @param length The pointer the length of the source is stored at.
+ * @param mapped The pointer a flag is stored at that tells whether the source
+ *	is mapped into memory.
+ * @return The source or <code>NULL</code> if the stream could not be read.
+ *	It must be released with <code>brainfuck_release_source</code>.
+ */
+char * brainfuck_read_source(FILE *stream, size_t *length, int *mapped) {
+	char *source = NULL;
+	char *grown;
+	size_t capacity = 0;
+	size_t count;
+	if (stream == NULL || length == NULL || mapped == NULL)
+		return NULL;
+	*length = 0;
+	*mapped = 0;
+#ifdef BRAINFUCK_LOAD_MMAP
+	struct stat info;
+	void *map;
+	if (fstat(fileno(stream), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 &&
+			ftell(stream) == 0) {
+		map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fileno(stream), 0);
+		if (map != MAP_FAILED) {
+			madvise(map, (size_t) info.st_size, MADV_SEQUENTIAL);
+			*length = (size_t) info.st_size;
+			*mapped = 1;
+			return (char *) map;
+		}
+	}
+#endif
+	do {
+		if (*length == capacity) {
+			capacity += BRAINFUCK_LOAD_CHUNK;
+			grown = realloc(source, capacity);
+			if (grown == NULL) {
+				free(source);
+				return NULL;
+			}
+			source = grown;
+		}
+		count = fread(source + *length, 1, capacity - *length, stream);
+		*length += count;
+	} while (count > 0);
+	return source;
+}
+
+/*
+ * Releases a source that is read with <code>brainfuck_read_source</code>.
+ *
+ * @param source The source.
+ * @param length The length of the source.
+ * @param mapped The flag that tells whether the source is mapped into memory.
+ */
+void brainfuck_release_source(char *source, size_t length, int mapped) {
+	if (source == NULL)
+		return;
+#ifdef BRAINFUCK_LOAD_MMAP
+	if (mapped) {
+		munmap(source, length);
+		return;
+	}
+#endif
+	(void) length;
+	(void) mapped;
+	free(source);
+}
+
+/*
+ * Reads instructions from the given stream until EOF occurs and adds them to the
+ * 	given state. Regular files are mapped into memory, other streams are
+ * 	read in large chunks. The instructions are allocated from the arena of
+ * 	the state.
+ *
+ * @param state The state to add the instructions to.
+ * @param stream The stream to read from.
+ * @return The head of the linked list containing the instructions or
+ *	<code>NULL</code> if the stream could not be read or a bracket has no
+ *	match.
+ */
+BrainfuckInstruction * brainfuck_state_parse_stream(BrainfuckState *state, FILE *stream) {
+	BrainfuckInstruction *root;
+	char *source;
+	size_t length;
+	int mapped;
+	if (state == NULL || stream == NULL)
+		return NULL;
+	source = brainfuck_read_source(stream, &length, &mapped);
+	if (source == NULL)
+		return NULL;
+	root = brainfuck_state_parse_buffer(state, source, length);
+	brainfuck_release_source(source, length, mapped);
+	return root;
+}
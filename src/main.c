@@ -23,17 +23,453 @@
 #	define isatty _isatty
 #endif
 
+#if defined(__unix__) || defined(__APPLE__)
+#	define PARALLEL_JOBS 1
+#	define THREAD_LOCAL __thread
+#	include <pthread.h>
+#	include <setjmp.h>
+#else
+#	define THREAD_LOCAL
+#endif
+
 #include "../include/brainfuck.h"
 
+/*
+ * The engines that are able to execute a program.
+ */
+enum {
+	ENGINE_LIST,
+	ENGINE_SWITCH,
+	ENGINE_THREADED,
+	ENGINE_JIT
+};
+
+/*
+ * The engine that is used to execute programs.
+ */
+static int engine = ENGINE_THREADED;
+
+/*
+ * The optimization level; <code>0</code> disables all optimizations.
+ */
+static int optimization_level = 2;
+
+/*
+ * A flag that, if set, causes programs to be translated into C instead of
+ * 	being executed.
+ */
+static int emit_c = 0;
+
+/*
+ * A flag that, if set, causes programs to read their input from a file that
+ * 	replaces the standard input and is mapped into memory when possible.
+ */
+static int map_input = 0;
+
+/*
+ * The value a cell is given when input is read after the end of the input.
+ */
+static int eof_behavior = BRAINFUCK_EOF_MINUS_ONE;
+
+/*
+ * A flag that, if set, causes programs to run on a virtual tape that extends in
+ * 	both directions and is protected by guard pages.
+ */
+static int virtual_tape = 0;
+
+/*
+ * The width of a cell in bits: 8, 16 or 32.
+ */
+static int cell_bits = 8;
+
+/*
+ * A flag that, if cleared, causes programs to terminate when a cell leaves its
+ * 	range instead of wrapping around.
+ */
+static int cell_wrap = 1;
+
+/*
+ * The amount of files or records that are run at the same time, or
+ * 	<code>0</code> if it is not given.
+ */
+static int job_count = 0;
+
+/*
+ * The input every job reads when files are run in parallel, or
+ * 	<code>NULL</code> to read the standard input directly.
+ */
+static const char *shared_input = NULL;
+
+/*
+ * The size of <code>shared_input</code>.
+ */
+static size_t shared_input_length = 0;
+
+/*
+ * The directory compiled programs are cached in, or <code>NULL</code> to
+ * 	compile every program from its source.
+ */
+static const char *cache_directory = NULL;
+
+/*
+ * A flag that, if set, causes the program to run once for every record of its
+ * 	input instead of once for the whole input.
+ */
+static int batch_mode = 0;
+
+/*
+ * The delimiter of the records of a batch.
+ */
+static int batch_delimiter = '\n';
+
+/*
+ * A flag that, if set, causes the records of a batch to run in lockstep.
+ */
+static int batch_lanes = 0;
+
+/*
+ * The amount of loops the profile reports, or <code>0</code> if programs are
+ * 	not profiled.
+ */
+static int profile_top = 0;
+
+/*
+ * The memory that is held while a program runs, which a job frees itself
+ * 	when its program fails and leaves through longjmp.
+ */
+typedef struct Held {
+	/*
+	 * The source of the program or <code>NULL</code>.
+	 */
+	char *source;
+	size_t source_length;
+	int source_mapped;
+	/*
+	 * The compiled program or <code>NULL</code>.
+	 */
+	BrainfuckProgram *program;
+	/*
+	 * The native code of the program or <code>NULL</code>.
+	 */
+	BrainfuckJitProgram *jit;
+} Held;
+
+/*
+ * The memory the program of the current thread holds.
+ */
+static THREAD_LOCAL Held held;
+
+/*
+ * The callback the errors of the current thread are written to, or
+ * 	<code>NULL</code> for the standard error. Jobs collect their errors,
+ * 	so that they are written in the order of the files.
+ */
+static THREAD_LOCAL BrainfuckWriteHandler report_handler;
+
+/*
+ * Reports the given error of the current thread.
+ *
+ * @param message The error message, which ends with a newline.
+ */
+void report_error(const char *message) {
+	if (report_handler != NULL)
+		report_handler(message, strlen(message));
+	else
+		fputs(message, stderr);
+}
+
 /*
  * Prints the usage message of this program.
  */
 void print_usage() {
-	fprintf(stderr, "usage: brainfuck [-eih] file...\n");
+	fprintf(stderr, "usage: brainfuck [-eEOSicjh] file...\n");
 	fprintf(stderr,	"\t-e  run code directly\n");
+	fprintf(stderr,	"\t-E  select the engine (list, switch, threaded or jit)\n");
+	fprintf(stderr,	"\t--jit  compile to native code (same as -E jit)\n");
+	fprintf(stderr,	"\t-O  set the optimization level (0 to 3)\n");
+	fprintf(stderr,	"\t-S  translate to C and write it to stdout\n");
+	fprintf(stderr,	"\t-i  read the input of the program from a file\n");
+	fprintf(stderr,	"\t--eof  set the cell at the end of input (unchanged, 0 or -1)\n");
+	fprintf(stderr,	"\t--virtual-tape  use a large tape that extends in both directions\n");
+	fprintf(stderr,	"\t-c  set the width of a cell in bits (8, 16 or 32)\n");
+	fprintf(stderr,	"\t--no-wrap  stop with an error when a cell leaves its range\n");
+	fprintf(stderr,	"\t-j  run up to the given amount of files at the same time\n");
+	fprintf(stderr,	"\t--cache  keep compiled programs in the given directory\n");
+	fprintf(stderr,	"\t--profile  report the hottest loops (10 or the given amount)\n");
+	fprintf(stderr,	"\t--batch  run the program for every line of the input (or length-prefixed record)\n");
+	fprintf(stderr,	"\t--lanes  run the records of a batch 16 at a time in lockstep\n");
 	fprintf(stderr,	"\t-h  show a help message\n");
 }
 
+/*
+ * Creates a context that reads its input as requested on the command line.
+ *
+ * @return The context.
+ */
+BrainfuckExecutionContext * create_context() {
+	BrainfuckExecutionContext *context = virtual_tape ? brainfuck_context_virtual() : NULL;
+	if (context == NULL)
+		context = brainfuck_context(BRAINFUCK_TAPE_SIZE);
+	context->eof_behavior = eof_behavior;
+	context->cell_bits = cell_bits;
+	context->cell_wrap = cell_wrap;
+	// files that can not be mapped, such as pipes, are read like the standard input
+	if (shared_input != NULL)
+		brainfuck_set_input(context, shared_input, shared_input_length);
+	else if (map_input)
+		brainfuck_map_input(context, stdin);
+	return context;
+}
+
+/*
+ * Optimizes the instructions of the given state as requested on the command line.
+ *
+ * @param state The state containing the instructions.
+ */
+void optimize_state(BrainfuckState *state) {
+	state->cell_wrap = cell_wrap;
+	if (optimization_level > 0)
+		brainfuck_optimize(state);
+	if (optimization_level > 1)
+		brainfuck_optimize_offsets(state);
+	if (optimization_level > 0)
+		brainfuck_optimize_dead(state);
+}
+
+/*
+ * Compiles the instructions of the given state and, at the highest optimization
+ * 	level, evaluates the part of the program that does not depend on input.
+ *
+ * @param state The state containing the instructions.
+ * @param context The context the program is executed with.
+ * @param positions Whether the source positions of the operations are recorded.
+ * @return The compiled program or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckProgram * compile_state(BrainfuckState *state, BrainfuckExecutionContext *context, int positions) {
+	BrainfuckProgram *program = positions ? brainfuck_compile_with_positions(state->root) :
+		brainfuck_compile(state->root);
+	// a program that can not be evaluated still runs as it is
+	if (program != NULL && optimization_level > 2)
+		brainfuck_evaluate(program, context, BRAINFUCK_EVALUATE_BUDGET);
+	return program;
+}
+
+/*
+ * Executes the given compiled program using the selected engine.
+ *
+ * @param program The program to execute.
+ * @param context The context of this execution.
+ */
+void run_program(BrainfuckProgram *program, BrainfuckExecutionContext *context) {
+	// native code is only generated for 8-bit cells that wrap around
+	if (engine == ENGINE_JIT && cell_bits == 8 && cell_wrap) {
+		BrainfuckJitProgram *jit = brainfuck_jit_compile_program(program);
+		if (jit != NULL) {
+			held.jit = jit;
+			brainfuck_jit_run(jit, context);
+			held.jit = NULL;
+			brainfuck_destroy_jit(jit);
+			return;
+		}
+		// not supported on this architecture, use the interpreter instead
+	}
+	if (engine == ENGINE_SWITCH)
+		brainfuck_execute_program_switch(program, context);
+	else
+		brainfuck_execute_program_threaded(program, context);
+}
+
+/*
+ * Optimizes, compiles and executes the instructions of the given state using the
+ * 	selected engine, or translates them to C if requested. Falls back to
+ * 	executing the linked list directly if it can not be compiled.
+ *
+ * @param state The state containing the instructions.
+ * @param context The context of this execution.
+ * @return EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+ */
+int run_state(BrainfuckState *state, BrainfuckExecutionContext *context) {
+	optimize_state(state);
+	if (emit_c) {
+		if (cell_bits != 8 || !cell_wrap) {
+			fprintf(stderr, "error: C can only be emitted for 8-bit cells that wrap around\n");
+			return EXIT_FAILURE;
+		}
+		// the code may still be buffered, and writing it out may fail as well
+		if (brainfuck_emit_c(stdout, state->root, context->tape_size) < 0 || fflush(stdout) != 0) {
+			fprintf(stderr, "error: failed to write C code\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	BrainfuckProgram *program = engine == ENGINE_LIST ? NULL : compile_state(state, context, 0);
+	if (program == NULL) {
+		brainfuck_execute(state->root, context);
+		return EXIT_SUCCESS;
+	}
+	held.program = program;
+	run_program(program, context);
+	held.program = NULL;
+	brainfuck_destroy_program(program);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Runs the given source with the profiling engine and reports its hottest loops
+ * 	to the standard error once it ends.
+ *
+ * @param state The state to add the instructions to.
+ * @param source The source of the program.
+ * @param length The length of the source.
+ * @param context The context of this execution.
+ * @return EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+ */
+int run_profiled(BrainfuckState *state, const char *source, size_t length, BrainfuckExecutionContext *context) {
+	BrainfuckProgram *program;
+	unsigned long long *counts;
+	if (brainfuck_state_parse_buffer(state, source, length) == NULL)
+		return EXIT_FAILURE;
+	optimize_state(state);
+	program = compile_state(state, context, 1);
+	if (program == NULL) {
+		fprintf(stderr, "error: failed to compile the program\n");
+		return EXIT_FAILURE;
+	}
+	held.program = program;
+	counts = brainfuck_profile_program(program, context);
+	held.program = NULL;
+	if (counts == NULL) {
+		fprintf(stderr, "error: failed to allocate the profile\n");
+		brainfuck_destroy_program(program);
+		return EXIT_FAILURE;
+	}
+	// the report follows the output of the program
+	fflush(stdout);
+	brainfuck_profile_report(stderr, program, counts, source, length, profile_top);
+	free(counts);
+	brainfuck_destroy_program(program);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Compiles the program in the given stream while it is read, without building
+ * 	its instructions, which is only done if no optimization needs them.
+ *
+ * @param file The stream to read the program from.
+ * @return The compiled program or <code>NULL</code> if it could not be compiled.
+ */
+BrainfuckProgram * parse_program(FILE *file) {
+	BrainfuckParser *parser = brainfuck_parser();
+	BrainfuckProgram *program = NULL;
+	char chunk[65536];
+	size_t length;
+	if (parser == NULL) {
+		report_error("error: out of memory\n");
+		return NULL;
+	}
+	parser->cell_wrap = cell_wrap;
+	parser->report_handler = report_handler;
+	// the loops are left as they are, like every other optimization at this level
+	parser->rewrite = 0;
+	while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0 && brainfuck_parser_feed(parser, chunk, length) == 0)
+		;
+	// a program that is cut short is not run
+	if (ferror(file))
+		report_error("error: failed to read the program\n");
+	else if (!parser->failed)
+		program = brainfuck_parser_finish(parser);
+	brainfuck_destroy_parser(parser);
+	return program;
+}
+
+/*
+ * Runs the program in the given stream using the compiled program in the cache
+ * 	directory if there is one for its source, and stores it there
+ * 	otherwise.
+ *
+ * @param state The state the instructions are added to if the program is not
+ *	cached.
+ * @param file The stream to read the program from.
+ * @param context The context of this execution.
+ * @return EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+ */
+int run_cached(BrainfuckState *state, FILE *file, BrainfuckExecutionContext *context) {
+	BrainfuckProgram *program;
+	unsigned long long key;
+	size_t length;
+	int mapped;
+	char *source = brainfuck_read_source(file, &length, &mapped);
+	if (source == NULL)
+		return EXIT_FAILURE;
+	key = brainfuck_cache_key(source, length, optimization_level, cell_bits, cell_wrap);
+	program = brainfuck_cache_load(cache_directory, key);
+	if (program == NULL) {
+		if (brainfuck_state_parse_buffer(state, source, length) == NULL) {
+			brainfuck_release_source(source, length, mapped);
+			return EXIT_FAILURE;
+		}
+		optimize_state(state);
+		program = compile_state(state, context, 0);
+		// a cache that can not be written only costs the next run its time
+		if (program != NULL)
+			brainfuck_cache_store(cache_directory, key, program);
+	}
+	brainfuck_release_source(source, length, mapped);
+	if (program == NULL) {
+		brainfuck_execute(state->root, context);
+		return EXIT_SUCCESS;
+	}
+	held.program = program;
+	run_program(program, context);
+	held.program = NULL;
+	brainfuck_destroy_program(program);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Runs the program in the given stream, through the cache if one is given.
+ * 	Without optimizations the program is compiled while it is read.
+ *
+ * @param state The state to add the instructions to.
+ * @param file The stream to read the program from.
+ * @param context The context of this execution.
+ * @return EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+ */
+int run_stream(BrainfuckState *state, FILE *file, BrainfuckExecutionContext *context) {
+	BrainfuckProgram *program;
+	size_t length;
+	int mapped;
+	int status;
+	char *source;
+	if (profile_top > 0 && !emit_c) {
+		source = brainfuck_read_source(file, &length, &mapped);
+		if (source == NULL)
+			return EXIT_FAILURE;
+		held.source = source;
+		held.source_length = length;
+		held.source_mapped = mapped;
+		status = run_profiled(state, source, length, context);
+		held.source = NULL;
+		brainfuck_release_source(source, length, mapped);
+		return status;
+	}
+	if (cache_directory != NULL && !emit_c && engine != ENGINE_LIST)
+		return run_cached(state, file, context);
+	if (optimization_level == 0 && !emit_c && engine != ENGINE_LIST) {
+		program = parse_program(file);
+		if (program == NULL)
+			return EXIT_FAILURE;
+		held.program = program;
+		run_program(program, context);
+		held.program = NULL;
+		brainfuck_destroy_program(program);
+		return EXIT_SUCCESS;
+	}
+	if (brainfuck_state_parse_stream(state, file) == NULL)
+		return EXIT_FAILURE;
+	return run_state(state, context);
+}
+
 /*
  * Runs the given brainfuck file.
  *
@@ -42,18 +478,17 @@ void print_usage() {
  */
 int run_file(FILE *file) {
 	BrainfuckState *state = brainfuck_state();
-	BrainfuckExecutionContext *context = brainfuck_context(BRAINFUCK_TAPE_SIZE);
+	BrainfuckExecutionContext *context = create_context();
 	if (file == NULL) {
 		brainfuck_destroy_context(context);
 		brainfuck_destroy_state(state);
 		return EXIT_FAILURE;
 	}
-	brainfuck_add(state, brainfuck_parse_stream(file));
-	brainfuck_execute(state->root, context);
+	int status = run_stream(state, file, context);
 	brainfuck_destroy_context(context);
 	brainfuck_destroy_state(state);
 	fclose(file);
-	return EXIT_SUCCESS;
+	return status;
 }
 
 /*
@@ -64,15 +499,372 @@ int run_file(FILE *file) {
  */
 int run_string(char *code) {
 	BrainfuckState *state = brainfuck_state();
-	BrainfuckExecutionContext *context = brainfuck_context(BRAINFUCK_TAPE_SIZE);
-	BrainfuckInstruction *instruction = brainfuck_parse_string(code);
- 	brainfuck_add(state, instruction);
- 	brainfuck_execute(state->root, context);
+	BrainfuckExecutionContext *context = create_context();
+	int status = EXIT_FAILURE;
+	if (profile_top > 0 && !emit_c) {
+		status = run_profiled(state, code, strlen(code), context);
+	} else if (brainfuck_state_parse_string(state, code) != NULL) {
+		status = run_state(state, context);
+	}
 	brainfuck_destroy_context(context);
  	brainfuck_destroy_state(state);
- 	return EXIT_SUCCESS;
+ 	return status;
+}
+
+/*
+ * Compiles the program in the given stream once and runs it for every record of
+ * 	the standard input, on as many threads as there are processors unless
+ * 	the amount of jobs is given. The outputs are written in the order of
+ * 	the records.
+ *
+ * @param file The stream to read the program from.
+ * @return EXIT_SUCCESS if all records succeed, otherwise EXIT_FAILURE.
+ */
+int run_batch(FILE *file) {
+	BrainfuckState *state = brainfuck_state();
+	BrainfuckExecutionContext *context;
+	BrainfuckProgram *program = NULL;
+	BrainfuckBatch *batch;
+	int status = EXIT_FAILURE;
+	size_t length;
+	int mapped;
+	char *input;
+	if (optimization_level == 0) {
+		program = parse_program(file);
+	} else if (brainfuck_state_parse_stream(state, file) != NULL) {
+		optimize_state(state);
+		context = create_context();
+		program = compile_state(state, context, 0);
+		brainfuck_destroy_context(context);
+	}
+	brainfuck_destroy_state(state);
+	if (program == NULL)
+		return EXIT_FAILURE;
+	input = brainfuck_read_source(stdin, &length, &mapped);
+	batch = brainfuck_batch(program);
+	if (input == NULL || batch == NULL) {
+		fprintf(stderr, "error: failed to read the input\n");
+	} else {
+		// every record is given to the program on its own
+		map_input = 0;
+		batch->engine = engine == ENGINE_SWITCH ? &brainfuck_execute_program_switch :
+			&brainfuck_execute_program_threaded;
+		batch->context_factory = &create_context;
+		batch->delimiter = batch_delimiter;
+		batch->lanes = batch_lanes;
+		if (job_count > 0)
+			batch->threads = job_count;
+		if (brainfuck_batch_run(batch, input, length) == 0)
+			status = EXIT_SUCCESS;
+	}
+	if (input != NULL)
+		brainfuck_release_source(input, length, mapped);
+	brainfuck_destroy_batch(batch);
+	brainfuck_destroy_program(program);
+	return status;
+}
+
+#ifdef PARALLEL_JOBS
+/*
+ * A file that is run in parallel with other files.
+ */
+typedef struct Job {
+	/*
+	 * The path of the file.
+	 */
+	const char *path;
+	/*
+	 * The output of the program, which is written once all jobs before this
+	 * 	one are written.
+	 */
+	char *output;
+	size_t output_length;
+	size_t output_capacity;
+	/*
+	 * The error message of the job or <code>NULL</code>.
+	 */
+	char *error;
+	/*
+	 * EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+	 */
+	int status;
+	/*
+	 * A flag that is set once the job is finished.
+	 */
+	int done;
+} Job;
+
+/*
+ * A thread of the pool and the jobs that are assigned to it. The thread takes
+ * 	jobs from the front of its range; threads that run out of jobs steal
+ * 	from the back of the ranges of other threads.
+ */
+typedef struct Worker {
+	pthread_t thread;
+	/*
+	 * The lock that protects the range of jobs.
+	 */
+	pthread_mutex_t lock;
+	/*
+	 * The range of jobs that are assigned to this thread and not yet taken.
+	 */
+	size_t begin;
+	size_t end;
+	/*
+	 * The index of this thread in the pool.
+	 */
+	int index;
+} Worker;
+
+/*
+ * The pool of threads that runs the jobs.
+ */
+static Job *pool_jobs;
+static Worker *pool_workers;
+static int pool_size;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+/*
+ * The job the current thread runs and the point its errors return to.
+ */
+static __thread Job *current_job;
+static __thread jmp_buf *current_jump;
+
+/*
+ * Appends the given output to the job of the current thread.
+ *
+ * @param buffer The characters to write.
+ * @param length The amount of characters to write.
+ * @return The amount of characters that are written.
+ */
+static size_t job_write(const char *buffer, size_t length) {
+	Job *job = current_job;
+	char *grown;
+	size_t capacity = job->output_capacity;
+	if (job->output_length + length > capacity) {
+		while (job->output_length + length > capacity)
+			capacity = capacity == 0 ? BRAINFUCK_OUTPUT_BUFFER_SIZE : capacity * 2;
+		grown = realloc(job->output, capacity);
+		if (grown == NULL) {
+			fprintf(stderr, "error: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		job->output = grown;
+		job->output_capacity = capacity;
+	}
+	memcpy(job->output + job->output_length, buffer, length);
+	job->output_length += length;
+	return length;
+}
+
+/*
+ * Appends the given error to the errors of the job of the current thread,
+ * 	preceded by the path of its file.
+ *
+ * @param buffer The characters of the error.
+ * @param length The amount of characters.
+ * @return The amount of characters that are written.
+ */
+static size_t job_report(const char *buffer, size_t length) {
+	Job *job = current_job;
+	size_t used = job->error != NULL ? strlen(job->error) : 0;
+	size_t size = strlen(job->path) + length + 3;
+	char *grown = realloc(job->error, used + size);
+	if (grown == NULL)
+		return 0;
+	snprintf(grown + used, size, "%s: %.*s", job->path, (int) length, buffer);
+	job->error = grown;
+	return length;
+}
+
+/*
+ * Records the error of the job of the current thread and abandons the job.
+ *
+ * @param context The context of the job.
+ * @param message The error message.
+ */
+static void job_fail(BrainfuckExecutionContext *context, const char *message) {
+	(void) context;
+	job_report(message, strlen(message));
+	longjmp(*current_jump, 1);
+}
+
+/*
+ * Parses and runs the given job with its own context.
+ *
+ * @param job The job to run.
+ */
+static void job_run(Job *job) {
+	// volatile, since these are still used after a failed job returns through longjmp
+	BrainfuckState * volatile state = brainfuck_state();
+	BrainfuckExecutionContext * volatile context = create_context();
+	FILE * volatile file = fopen(job->path, "r");
+	jmp_buf jump;
+	job->status = EXIT_FAILURE;
+	current_job = job;
+	current_jump = &jump;
+	context->write_handler = &job_write;
+	context->error_handler = &job_fail;
+	// parse errors are written in the order of the files as well
+	report_handler = &job_report;
+	state->report_handler = &job_report;
+	if (file == NULL) {
+		size_t length = strlen(job->path) + 64;
+		job->error = malloc(length);
+		if (job->error != NULL)
+			snprintf(job->error, length, "error: failed to read file %s\n", job->path);
+	} else if (setjmp(jump) == 0) {
+		job->status = run_stream(state, file, context);
+	} else {
+		// the program failed, so the memory it held is not released on the way out
+		brainfuck_destroy_jit(held.jit);
+		brainfuck_destroy_program(held.program);
+		brainfuck_release_source(held.source, held.source_length, held.source_mapped);
+		memset(&held, 0, sizeof(Held));
+	}
+	if (file != NULL)
+		fclose(file);
+	report_handler = NULL;
+	brainfuck_destroy_context(context);
+	brainfuck_destroy_state(state);
+	pthread_mutex_lock(&pool_lock);
+	job->done = 1;
+	pthread_cond_broadcast(&pool_done);
+	pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Takes the next job for the given thread, stealing it from another thread if
+ * 	its own jobs are taken.
+ *
+ * @param worker The thread.
+ * @return The job or <code>NULL</code> if all jobs are taken.
+ */
+static Job * worker_take(Worker *worker) {
+	Worker *victim;
+	Job *job = NULL;
+	int i;
+	for (i = 0; i < pool_size && job == NULL; i++) {
+		victim = &pool_workers[(worker->index + i) % pool_size];
+		pthread_mutex_lock(&victim->lock);
+		if (victim->begin < victim->end)
+			job = &pool_jobs[victim == worker ? victim->begin++ : --victim->end];
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return job;
+}
+
+/*
+ * Runs jobs until all jobs are taken.
+ *
+ * @param argument The thread.
+ * @return <code>NULL</code>.
+ */
+static void * worker_main(void *argument) {
+	Worker *worker = (Worker *) argument;
+	Job *job;
+	while ((job = worker_take(worker)) != NULL)
+		job_run(job);
+	return NULL;
+}
+
+/*
+ * Reads the whole standard input, which every job receives as its input.
+ *
+ * @param length The pointer the size of the input is stored at.
+ * @return The input or <code>NULL</code> if it could not be read.
+ */
+static char * read_shared_input(size_t *length) {
+	char *input = NULL;
+	char *grown;
+	size_t capacity = 0;
+	size_t count;
+	*length = 0;
+	do {
+		if (*length == capacity) {
+			capacity += 65536;
+			grown = realloc(input, capacity);
+			if (grown == NULL) {
+				free(input);
+				return NULL;
+			}
+			input = grown;
+		}
+		count = fread(input + *length, 1, capacity - *length, stdin);
+		*length += count;
+	} while (count > 0);
+	return input;
 }
 
+/*
+ * Runs the given files on a pool of threads, each with its own context, and
+ * 	writes their outputs in the order of the files.
+ *
+ * @param paths The paths of the files.
+ * @param count The amount of files.
+ * @return EXIT_SUCCESS if no errors are encountered, otherwise EXIT_FAILURE.
+ */
+int run_parallel(char **paths, int count) {
+	int status = EXIT_SUCCESS;
+	int started = 0;
+	char *input = NULL;
+	size_t length = 0;
+	int i;
+	// a terminal can not be shared, so jobs only get input that is piped or given
+	if (map_input || !isatty(fileno(stdin)))
+		input = read_shared_input(&length);
+	shared_input = input != NULL ? input : "";
+	shared_input_length = length;
+	pool_size = job_count < count ? job_count : count;
+	pool_jobs = calloc(count, sizeof(Job));
+	pool_workers = calloc(pool_size, sizeof(Worker));
+	if (pool_jobs == NULL || pool_workers == NULL) {
+		fprintf(stderr, "error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < count; i++)
+		pool_jobs[i].path = paths[i];
+	for (i = 0; i < pool_size; i++) {
+		pool_workers[i].index = i;
+		pool_workers[i].begin = (size_t) count * i / pool_size;
+		pool_workers[i].end = (size_t) count * (i + 1) / pool_size;
+		pthread_mutex_init(&pool_workers[i].lock, NULL);
+	}
+	for (i = 0; i < pool_size; i++) {
+		if (pthread_create(&pool_workers[i].thread, NULL, &worker_main, &pool_workers[i]) != 0)
+			break;
+		started++;
+	}
+	// the remaining jobs are stolen by the threads that did start
+	if (started == 0)
+		worker_main(&pool_workers[0]);
+	for (i = 0; i < count; i++) {
+		pthread_mutex_lock(&pool_lock);
+		while (!pool_jobs[i].done)
+			pthread_cond_wait(&pool_done, &pool_lock);
+		pthread_mutex_unlock(&pool_lock);
+		fwrite(pool_jobs[i].output, 1, pool_jobs[i].output_length, stdout);
+		fflush(stdout);
+		if (pool_jobs[i].error != NULL)
+			fputs(pool_jobs[i].error, stderr);
+		if (pool_jobs[i].status != EXIT_SUCCESS)
+			status = EXIT_FAILURE;
+		free(pool_jobs[i].output);
+		free(pool_jobs[i].error);
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(pool_workers[i].thread, NULL);
+	for (i = 0; i < pool_size; i++)
+		pthread_mutex_destroy(&pool_workers[i].lock);
+	free(pool_workers);
+	free(pool_jobs);
+	free(input);
+	shared_input = NULL;
+	return status;
+}
+#endif
+
 /*
  * Run the brainfuck interpreter in interactive mode.
  */
@@ -96,6 +888,20 @@ void run_interactive_console() {
 static struct option long_options[] = {
 	{"help", no_argument, 0, 'h'},
 	{"eval", required_argument, 0, 'e'},
+	{"engine", required_argument, 0, 'E'},
+	{"optimize", required_argument, 0, 'O'},
+	{"jit", no_argument, 0, 'J'},
+	{"emit-c", no_argument, 0, 'S'},
+	{"input", required_argument, 0, 'i'},
+	{"eof", required_argument, 0, 'F'},
+	{"virtual-tape", no_argument, 0, 'V'},
+	{"cell-size", required_argument, 0, 'c'},
+	{"no-wrap", no_argument, 0, 'W'},
+	{"jobs", required_argument, 0, 'j'},
+	{"cache", required_argument, 0, 'K'},
+	{"profile", optional_argument, 0, 'P'},
+	{"batch", optional_argument, 0, 'B'},
+	{"lanes", no_argument, 0, 'L'},
 	{0, 0, 0, 0}
 };
 
@@ -109,10 +915,12 @@ int main(int argc, char *argv[]) {
 	int c;
 	int i = 1;
 	int option_index = 0;
+	int status = EXIT_SUCCESS;
+	FILE *file;
 	
 	while (1) {
 		option_index = 0;
-		c = getopt_long (argc, argv, "he:",
+		c = getopt_long (argc, argv, "he:E:O:Si:c:j:",
 			long_options, &option_index);
 		if (c == -1)
 			break;
@@ -127,6 +935,90 @@ int main(int argc, char *argv[]) {
 			return EXIT_SUCCESS;
 		case 'e':	
  			return run_string((char *) optarg);
+		case 'E':
+			if (strcmp(optarg, "list") == 0) {
+				engine = ENGINE_LIST;
+			} else if (strcmp(optarg, "switch") == 0) {
+				engine = ENGINE_SWITCH;
+			} else if (strcmp(optarg, "threaded") == 0) {
+				engine = ENGINE_THREADED;
+			} else if (strcmp(optarg, "jit") == 0) {
+				engine = ENGINE_JIT;
+			} else {
+				fprintf(stderr, "error: unknown engine %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'O':
+			optimization_level = atoi(optarg);
+			break;
+		case 'J':
+			engine = ENGINE_JIT;
+			break;
+		case 'S':
+			emit_c = 1;
+			break;
+		case 'i':
+			if (freopen(optarg, "r", stdin) == NULL) {
+				fprintf(stderr, "error: failed to read file %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			map_input = 1;
+			break;
+		case 'V':
+			virtual_tape = 1;
+			break;
+		case 'c':
+			cell_bits = atoi(optarg);
+			if (cell_bits != 8 && cell_bits != 16 && cell_bits != 32) {
+				fprintf(stderr, "error: unsupported cell size %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'W':
+			cell_wrap = 0;
+			break;
+		case 'K':
+			cache_directory = optarg;
+			break;
+		case 'P':
+			profile_top = optarg != NULL ? atoi(optarg) : 10;
+			if (profile_top < 1) {
+				fprintf(stderr, "error: invalid amount of loops %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'B':
+			batch_mode = 1;
+			if (optarg != NULL && strcmp(optarg, "length") == 0) {
+				batch_delimiter = BRAINFUCK_BATCH_LENGTH;
+			} else if (optarg != NULL && strcmp(optarg, "line") != 0) {
+				fprintf(stderr, "error: unknown kind of records %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'L':
+			batch_lanes = 1;
+			break;
+		case 'j':
+			job_count = atoi(optarg);
+			if (job_count < 1) {
+				fprintf(stderr, "error: invalid amount of jobs %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'F':
+			if (strcmp(optarg, "unchanged") == 0) {
+				eof_behavior = BRAINFUCK_EOF_UNCHANGED;
+			} else if (strcmp(optarg, "0") == 0) {
+				eof_behavior = BRAINFUCK_EOF_ZERO;
+			} else if (strcmp(optarg, "-1") == 0) {
+				eof_behavior = BRAINFUCK_EOF_MINUS_ONE;
+			} else {
+				fprintf(stderr, "error: unknown end of input behavior %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case '?':
 			print_usage();
 			return EXIT_FAILURE;
@@ -134,18 +1026,48 @@ int main(int argc, char *argv[]) {
 			abort();
 		}
 	}
-	if (argc > 1) {
-		while (i < argc)
-			if (run_file(fopen(argv[i++], "r")) == EXIT_FAILURE)
+	if (batch_mode) {
+		// the standard input holds the records, so the program must be a file
+		if (optind + 1 != argc || emit_c || profile_top > 0) {
+			print_usage();
+			return EXIT_FAILURE;
+		}
+		file = fopen(argv[optind], "r");
+		if (file == NULL) {
+			fprintf(stderr, "error: failed to read file %s\n", argv[optind]);
+			return EXIT_FAILURE;
+		}
+		status = run_batch(file);
+		fclose(file);
+		return status;
+	}
+#ifdef PARALLEL_JOBS
+	// translating to C and profiles write directly to the standard streams, so they stay sequential
+	if (optind < argc && job_count > 1 && !emit_c && profile_top == 0)
+		return run_parallel(argv + optind, argc - optind);
+#endif
+	if (optind < argc) {
+		i = optind;
+		while (i < argc) {
+			file = fopen(argv[i++], "r");
+			if (file == NULL) {
 				fprintf(stderr, "error: failed to read file %s\n", argv[i - 1]);
+				status = EXIT_FAILURE;
+			} else if (run_file(file) == EXIT_FAILURE) {
+				status = EXIT_FAILURE;
+			}
+		}
+	} else if (map_input) {
+		// the standard input is taken by the input of the program
+		print_usage();
+		return EXIT_FAILURE;
 	} else {
 		// checks if someone is piping code or just calling it the normal way.
 		if (isatty(fileno(stdin))) {
 			run_interactive_console();
 		} else {
-			if (run_file(stdin) == EXIT_FAILURE) 
-				fprintf(stderr, "error: failed to read from stdin\n");
+			status = run_file(stdin);
 		}
 	}
-	return EXIT_SUCCESS;
+	return status;
 }
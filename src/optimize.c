@@ -0,0 +1,839 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The maximum amount of cells a transfer loop may modify besides the current
+ * 	cell in order to be rewritten.
+ */
+#define BRAINFUCK_OPTIMIZE_MAX_TARGETS 16
+
+/*
+ * The maximum amount of distinct cells of a basic block that are tracked in
+ * 	order to merge additions to the same cell.
+ */
+#define BRAINFUCK_OPTIMIZE_MAX_CELLS 32
+
+/*
+ * The amount of nested loops the passes make room for once they find a loop.
+ * 	Their loop stacks grow on the heap, so the nesting depth is not
+ * 	limited by the C stack.
+ */
+#define BRAINFUCK_OPTIMIZE_DEPTH 64
+
+/*
+ * Makes room for one more entry on a stack that is kept on the heap, doubling
+ * 	its capacity if it is full.
+ *
+ * @param entries The entries of the stack or <code>NULL</code> if it is empty.
+ * @param depth The amount of entries on the stack.
+ * @param capacity The pointer to the amount of entries the stack can hold.
+ * @param size The size of an entry.
+ * @return The entries of the stack.
+ */
+static void * brainfuck_optimize_reserve(void *entries, size_t depth, size_t *capacity, size_t size) {
+	void *grown;
+	if (depth < *capacity)
+		return entries;
+	*capacity = *capacity == 0 ? BRAINFUCK_OPTIMIZE_DEPTH : *capacity * 2;
+	grown = realloc(entries, size * *capacity);
+	if (grown == NULL) {
+		fprintf(stderr, "error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return grown;
+}
+
+/*
+ * Returns the signed net amount of the given add or move instruction.
+ *
+ * @param instruction The instruction.
+ * @return The amount the cell or tape index changes by.
+ */
+static long brainfuck_optimize_amount(BrainfuckInstruction *instruction) {
+	switch (instruction->type) {
+	case BRAINFUCK_TOKEN_PLUS:
+	case BRAINFUCK_TOKEN_NEXT:
+		return (long) instruction->difference;
+	case BRAINFUCK_TOKEN_MINUS:
+	case BRAINFUCK_TOKEN_PREVIOUS:
+		return -(long) instruction->difference;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Determines whether the given addition can be merged into the given set or
+ * 	addition that writes the same cell before it. Without wrapping cells,
+ * 	the merged instruction must leave the range of the cell whenever one
+ * 	of the two does, so "[-]-" and "-+" are kept apart.
+ *
+ * @param state The state the instructions belong to.
+ * @param into The set or addition that is merged into.
+ * @param amount The amount of the addition.
+ * @return <code>1</code> if the addition can be merged, <code>0</code> otherwise.
+ */
+static int brainfuck_optimize_can_merge(BrainfuckState *state, BrainfuckInstruction *into, long amount) {
+	long value;
+	if (state->cell_wrap)
+		return 1;
+	if (into->type == BRAINFUCK_INSTRUCTION_SET) {
+		value = (long) into->difference + amount;
+		return value >= 0 && value <= 255;
+	}
+	return (brainfuck_optimize_amount(into) < 0) == (amount < 0);
+}
+
+/*
+ * Determines whether the given instruction is the last one in its list.
+ *
+ * @param instruction The instruction.
+ * @return <code>1</code> if no instructions follow, <code>0</code> otherwise.
+ */
+static int brainfuck_optimize_is_last(BrainfuckInstruction *instruction) {
+	return instruction->next == NULL || instruction->next->type == BRAINFUCK_TOKEN_LOOP_END;
+}
+
+/*
+ * Creates a new instruction that is not part of a list.
+ *
+ * @param state The state to allocate the instruction from.
+ * @param type The type of the instruction.
+ * @param difference The difference of the instruction.
+ * @param offset The offset of the instruction.
+ * @param origin The instruction whose source position the new instruction
+ *	takes over or <code>NULL</code>.
+ * @return The new instruction.
+ */
+static BrainfuckInstruction * brainfuck_optimize_instruction(BrainfuckState *state, char type,
+		unsigned long difference, long offset, const BrainfuckInstruction *origin) {
+	BrainfuckInstruction *instruction = brainfuck_allocate_instruction(state->arena != NULL ? state : NULL);
+	instruction->type = type;
+	instruction->difference = difference;
+	instruction->offset = offset;
+	if (origin != NULL) {
+		instruction->line = origin->line;
+		instruction->column = origin->column;
+	}
+	return instruction;
+}
+
+/*
+ * Releases the given instructions that are no longer part of the program.
+ * 	Instructions that are allocated from the arena of the state are left
+ * 	alone, since they are freed together with the state.
+ *
+ * @param state The state the instructions belong to.
+ * @param instruction The instruction to release.
+ * @param list Whether the instructions that follow should be released as well.
+ */
+static void brainfuck_optimize_release(BrainfuckState *state, BrainfuckInstruction *instruction, int list) {
+	if (state->arena != NULL)
+		return;
+	if (list)
+		brainfuck_destroy_instructions(instruction);
+	else
+		brainfuck_destroy_instruction(instruction);
+}
+
+/*
+ * Tries to rewrite a balanced loop that only adds to cells into multiplications.
+ * 	The loop must return to the cell it started at and change that cell by
+ * 	exactly one in every iteration, which must be an increment only if
+ * 	cells wrap around.
+ *
+ * @param state The state the instructions belong to.
+ * @param instruction The loop instruction to rewrite.
+ * @return <code>1</code> if the loop is rewritten, <code>0</code> otherwise.
+ */
+static int brainfuck_optimize_transfer(BrainfuckState *state, BrainfuckInstruction *instruction) {
+	long offsets[BRAINFUCK_OPTIMIZE_MAX_TARGETS + 1];
+	long deltas[BRAINFUCK_OPTIMIZE_MAX_TARGETS + 1];
+	int count = 1;
+	int i;
+	long position = 0;
+	BrainfuckInstruction *iter;
+	BrainfuckInstruction *last;
+
+	offsets[0] = 0;
+	deltas[0] = 0;
+	for (iter = instruction->loop; iter != NULL && iter->type != BRAINFUCK_TOKEN_LOOP_END; iter = iter->next) {
+		switch (iter->type) {
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			position += brainfuck_optimize_amount(iter);
+			break;
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+			for (i = 0; i < count && offsets[i] != position; i++)
+				;
+			if (i == count) {
+				if (count > BRAINFUCK_OPTIMIZE_MAX_TARGETS)
+					return 0;
+				offsets[count] = position;
+				deltas[count] = 0;
+				count++;
+			}
+			deltas[i] += brainfuck_optimize_amount(iter);
+			break;
+		default:
+			return 0;
+		}
+	}
+	// "[+>+<]" only ends once the cell wraps around
+	if (position != 0 || (deltas[0] != -1 && (deltas[0] != 1 || !state->cell_wrap)))
+		return 0;
+
+	/*
+	 * The loop runs -cell times if it increments the current cell and cell
+	 * 	times if it decrements it.
+	 */
+	brainfuck_optimize_release(state, instruction->loop, 1);
+	instruction->loop = 0;
+	last = instruction;
+	for (i = 1; i < count; i++) {
+		if (deltas[i] == 0)
+			continue;
+		if (instruction->type == BRAINFUCK_TOKEN_LOOP_START) {
+			instruction->type = BRAINFUCK_INSTRUCTION_MUL;
+			instruction->difference = (unsigned long) (deltas[i] * -deltas[0]);
+			instruction->offset = offsets[i];
+			continue;
+		}
+		iter = brainfuck_optimize_instruction(state, BRAINFUCK_INSTRUCTION_MUL,
+				(unsigned long) (deltas[i] * -deltas[0]), offsets[i], instruction);
+		iter->next = last->next;
+		iter->previous = last;
+		last->next = iter;
+		last = iter;
+	}
+	if (instruction->type == BRAINFUCK_TOKEN_LOOP_START) {
+		instruction->type = BRAINFUCK_INSTRUCTION_SET;
+		instruction->difference = 0;
+		return 1;
+	}
+	iter = brainfuck_optimize_instruction(state, BRAINFUCK_INSTRUCTION_SET, 0, 0, instruction);
+	iter->next = last->next;
+	iter->previous = last;
+	last->next = iter;
+	return 1;
+}
+
+/*
+ * Rewrites the given loop instruction if it matches one of the known loop
+ * 	shapes.
+ *
+ * @param state The state the instructions belong to.
+ * @param instruction The loop instruction.
+ * @return <code>1</code> if the loop is rewritten, <code>0</code> otherwise.
+ */
+static int brainfuck_optimize_loop(BrainfuckState *state, BrainfuckInstruction *instruction) {
+	BrainfuckInstruction *body = instruction->loop;
+	long amount;
+	if (body == NULL || body->type == BRAINFUCK_TOKEN_LOOP_END)
+		return 0;
+	if (brainfuck_optimize_is_last(body)) {
+		amount = brainfuck_optimize_amount(body);
+		switch (body->type) {
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+			// "[-]" and, if cells wrap around, "[+]"
+			if (amount != -1 && (amount != 1 || !state->cell_wrap))
+				return 0;
+			instruction->type = BRAINFUCK_INSTRUCTION_SET;
+			instruction->difference = 0;
+			break;
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			// "[>]", "[<<]", ...
+			if (amount == 0)
+				return 0;
+			instruction->type = BRAINFUCK_INSTRUCTION_SCAN;
+			instruction->difference = (unsigned long) amount;
+			break;
+		default:
+			return 0;
+		}
+		brainfuck_optimize_release(state, body, 1);
+		instruction->loop = 0;
+		return 1;
+	}
+	return brainfuck_optimize_transfer(state, instruction);
+}
+
+/*
+ * Optimizes the given linked list containing instructions and the loops
+ * 	it contains. A loop is rewritten once its body is optimized; the loops
+ * 	that are entered are kept on a stack on the heap.
+ *
+ * @param state The state the instructions belong to.
+ * @param instruction The start of the linked list of instructions.
+ * @return The amount of loops that are rewritten.
+ */
+static int brainfuck_optimize_list(BrainfuckState *state, BrainfuckInstruction *instruction) {
+	BrainfuckInstruction **loops = NULL;
+	size_t depth = 0;
+	size_t capacity = 0;
+	int count = 0;
+	BrainfuckInstruction *next;
+	for (;;) {
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			if (depth == 0)
+				break;
+			// the body is done, so the loop itself can be rewritten
+			instruction = loops[--depth];
+			count += brainfuck_optimize_loop(state, instruction);
+		} else if (instruction->type == BRAINFUCK_TOKEN_LOOP_START) {
+			loops = brainfuck_optimize_reserve(loops, depth, &capacity, sizeof(BrainfuckInstruction *));
+			loops[depth++] = instruction;
+			instruction = instruction->loop;
+			continue;
+		}
+		// fold additions into a preceding set, e.g. "[-]+++"
+		while (instruction->type == BRAINFUCK_INSTRUCTION_SET && (next = instruction->next) != NULL &&
+				(next->type == BRAINFUCK_TOKEN_PLUS || next->type == BRAINFUCK_TOKEN_MINUS) &&
+				brainfuck_optimize_can_merge(state, instruction, brainfuck_optimize_amount(next))) {
+			instruction->difference += brainfuck_optimize_amount(next);
+			instruction->next = next->next;
+			if (next->next != NULL)
+				next->next->previous = instruction;
+			brainfuck_optimize_release(state, next, 0);
+		}
+		instruction = instruction->next;
+	}
+	free(loops);
+	return count;
+}
+
+/*
+ * Rewrites common loops in the instruction list of the given state into
+ * 	single instructions: clear loops such as "[-]" become
+ * 	<code>BRAINFUCK_INSTRUCTION_SET</code>, scan loops such as "[>]" become
+ * 	<code>BRAINFUCK_INSTRUCTION_SCAN</code> and balanced transfer loops such
+ * 	as "[->+>++<<]" become a sequence of <code>BRAINFUCK_INSTRUCTION_MUL</code>
+ * 	followed by a <code>BRAINFUCK_INSTRUCTION_SET</code>.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of loops that are rewritten.
+ */
+int brainfuck_optimize(BrainfuckState *state) {
+	if (state == NULL)
+		return 0;
+	return brainfuck_optimize_list(state, state->root);
+}
+
+/*
+ * Determines whether the given instruction adds to a cell.
+ *
+ * @param instruction The instruction.
+ * @return <code>1</code> if the instruction is an addition, <code>0</code> otherwise.
+ */
+static int brainfuck_optimize_is_add(BrainfuckInstruction *instruction) {
+	return instruction->type == BRAINFUCK_TOKEN_PLUS || instruction->type == BRAINFUCK_TOKEN_MINUS;
+}
+
+/*
+ * Folds the pointer movement of every basic block in the given linked list
+ * 	into the offsets of its instructions and emits a single move at the
+ * 	end of the block. Additions to the same cell within a block are merged.
+ * 	Every loop starts a new block, so only the loops that are entered are
+ * 	kept, on a stack on the heap.
+ *
+ * @param state The state the instructions belong to.
+ * @param link The pointer to the start of the linked list of instructions.
+ * @return The amount of instructions that are removed.
+ */
+static int brainfuck_optimize_offsets_list(BrainfuckState *state, BrainfuckInstruction **link) {
+	long offsets[BRAINFUCK_OPTIMIZE_MAX_CELLS];
+	BrainfuckInstruction *cells[BRAINFUCK_OPTIMIZE_MAX_CELLS];
+	BrainfuckInstruction **loops = NULL;
+	size_t depth = 0;
+	size_t capacity = 0;
+	int count = 0;
+	int removed = 0;
+	int i;
+	long position = 0;
+	BrainfuckInstruction *instruction;
+	BrainfuckInstruction *move;
+	for (;;) {
+		instruction = *link;
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			// the list ends with the move of its last block
+			if (position != 0) {
+				move = brainfuck_optimize_instruction(state, position > 0 ? BRAINFUCK_TOKEN_NEXT :
+						BRAINFUCK_TOKEN_PREVIOUS, position > 0 ? position : -position, 0, instruction);
+				move->next = instruction;
+				*link = move;
+				position = 0;
+				removed--;
+			}
+			if (depth == 0)
+				break;
+			// continue after the loop whose body ended
+			instruction = loops[--depth];
+			count = 0;
+			link = &instruction->next;
+			continue;
+		}
+		switch (instruction->type) {
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			position += brainfuck_optimize_amount(instruction);
+			*link = instruction->next;
+			brainfuck_optimize_release(state, instruction, 0);
+			removed++;
+			continue;
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+		case BRAINFUCK_TOKEN_OUTPUT:
+		case BRAINFUCK_TOKEN_INPUT:
+		case BRAINFUCK_INSTRUCTION_SET:
+			instruction->offset += position;
+			for (i = 0; i < count && offsets[i] != instruction->offset; i++)
+				;
+			// merge into the last instruction that wrote this cell, e.g. "+>+<+"
+			if (i < count && brainfuck_optimize_is_add(instruction) &&
+					(brainfuck_optimize_is_add(cells[i]) || cells[i]->type == BRAINFUCK_INSTRUCTION_SET) &&
+					brainfuck_optimize_can_merge(state, cells[i], brainfuck_optimize_amount(instruction))) {
+				if (cells[i]->type == BRAINFUCK_INSTRUCTION_SET) {
+					cells[i]->difference += brainfuck_optimize_amount(instruction);
+				} else {
+					cells[i]->difference = brainfuck_optimize_amount(cells[i]) 
+						+ brainfuck_optimize_amount(instruction);
+					cells[i]->type = BRAINFUCK_TOKEN_PLUS;
+				}
+				*link = instruction->next;
+				brainfuck_optimize_release(state, instruction, 0);
+				removed++;
+				continue;
+			}
+			if (i < count) {
+				cells[i] = instruction;
+			} else if (count < BRAINFUCK_OPTIMIZE_MAX_CELLS) {
+				offsets[count] = instruction->offset;
+				cells[count++] = instruction;
+			}
+			break;
+		default:
+			// loops, scans and multiplications read the current cell, so the block ends here
+			if (position != 0) {
+				move = brainfuck_optimize_instruction(state, position > 0 ? BRAINFUCK_TOKEN_NEXT : 
+						BRAINFUCK_TOKEN_PREVIOUS, position > 0 ? position : -position, 0, instruction);
+				move->next = instruction;
+				*link = move;
+				position = 0;
+				removed--;
+			}
+			count = 0;
+			if (instruction->type == BRAINFUCK_TOKEN_LOOP_START) {
+				loops = brainfuck_optimize_reserve(loops, depth, &capacity, sizeof(BrainfuckInstruction *));
+				loops[depth++] = instruction;
+				link = &instruction->loop;
+				continue;
+			}
+			break;
+		}
+		link = &instruction->next;
+	}
+	free(loops);
+	return removed;
+}
+
+/*
+ * Folds pointer movement into the offsets of the instructions in the given
+ * 	state, so that every basic block addresses its cells relative to the
+ * 	pointer at the start of the block and moves the pointer only once at
+ * 	its end. This pass should run after <code>brainfuck_optimize</code>.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of instructions that are removed.
+ */
+int brainfuck_optimize_offsets(BrainfuckState *state) {
+	if (state == NULL)
+		return 0;
+	int removed = brainfuck_optimize_offsets_list(state, &state->root);
+	for (state->head = state->root; state->head != NULL && state->head->next != NULL; )
+		state->head = state->head->next;
+	return removed;
+}
+
+/*
+ * A cell whose value or last write is known while instructions are scanned
+ * 	for dead code.
+ */
+typedef struct BrainfuckOptimizeCell {
+	/*
+	 * The offset of the cell relative to the current cell.
+	 */
+	long offset;
+	/*
+	 * The value of the cell or <code>-1</code> if it is not known. Only
+	 * 	values that fit in a byte are tracked, since they are the same
+	 * 	for every cell width.
+	 */
+	long value;
+	/*
+	 * The last instruction that wrote the cell if it is not read since,
+	 * 	otherwise <code>NULL</code>.
+	 */
+	BrainfuckInstruction *store;
+} BrainfuckOptimizeCell;
+
+/*
+ * What is known about the tape at an instruction.
+ */
+typedef struct BrainfuckOptimizeTape {
+	BrainfuckOptimizeCell cells[BRAINFUCK_OPTIMIZE_MAX_CELLS];
+	int count;
+	/*
+	 * Whether cells that are not tracked are zero, which only holds until
+	 * 	the first loop at the start of the program.
+	 */
+	int zero;
+} BrainfuckOptimizeTape;
+
+/*
+ * Forgets everything that is known about the tape.
+ *
+ * @param tape The tape.
+ */
+static void brainfuck_optimize_forget(BrainfuckOptimizeTape *tape) {
+	tape->count = 0;
+	tape->zero = 0;
+}
+
+/*
+ * Returns the tracked cell at the given offset, starting to track it if
+ * 	needed.
+ *
+ * @param tape The tape.
+ * @param offset The offset of the cell.
+ * @return The cell or <code>NULL</code> if too many cells are tracked.
+ */
+static BrainfuckOptimizeCell * brainfuck_optimize_cell(BrainfuckOptimizeTape *tape, long offset) {
+	int i;
+	for (i = 0; i < tape->count; i++) {
+		if (tape->cells[i].offset == offset)
+			return &tape->cells[i];
+	}
+	if (tape->count == BRAINFUCK_OPTIMIZE_MAX_CELLS) {
+		// untracked cells may no longer be assumed to be zero
+		brainfuck_optimize_forget(tape);
+		return NULL;
+	}
+	tape->cells[tape->count].offset = offset;
+	tape->cells[tape->count].value = tape->zero ? 0 : -1;
+	tape->cells[tape->count].store = NULL;
+	return &tape->cells[tape->count++];
+}
+
+/*
+ * Returns the known value of the cell at the given offset.
+ *
+ * @param tape The tape.
+ * @param offset The offset of the cell.
+ * @return The value or <code>-1</code> if it is not known.
+ */
+static long brainfuck_optimize_value(BrainfuckOptimizeTape *tape, long offset) {
+	int i;
+	for (i = 0; i < tape->count; i++) {
+		if (tape->cells[i].offset == offset)
+			return tape->cells[i].value;
+	}
+	return tape->zero ? 0 : -1;
+}
+
+/*
+ * Records that the cell at the given offset is read, so its last write is
+ * 	needed.
+ *
+ * @param tape The tape.
+ * @param offset The offset of the cell.
+ */
+static void brainfuck_optimize_read(BrainfuckOptimizeTape *tape, long offset) {
+	int i;
+	for (i = 0; i < tape->count; i++) {
+		if (tape->cells[i].offset == offset)
+			tape->cells[i].store = NULL;
+	}
+}
+
+/*
+ * Records a write to the cell at the given offset.
+ *
+ * @param tape The tape.
+ * @param offset The offset of the cell.
+ * @param value The new value of the cell or <code>-1</code> if it is not known.
+ * @param store The instruction that writes the cell, if it could be removed
+ *	when the cell is overwritten before it is read.
+ */
+static void brainfuck_optimize_write(BrainfuckOptimizeTape *tape, long offset, long value,
+		BrainfuckInstruction *store) {
+	BrainfuckOptimizeCell *cell = brainfuck_optimize_cell(tape, offset);
+	if (cell == NULL)
+		return;
+	cell->value = value >= 0 && value <= 255 ? value : -1;
+	cell->store = store;
+}
+
+/*
+ * Marks the given instruction as removed, to be unlinked once its list is
+ * 	scanned.
+ *
+ * @param instruction The instruction.
+ * @return The amount of instructions that are removed with it.
+ */
+static int brainfuck_optimize_kill(BrainfuckInstruction *instruction) {
+	BrainfuckInstruction **loops = NULL;
+	BrainfuckInstruction *iter = instruction->loop;
+	size_t depth = 0;
+	size_t capacity = 0;
+	int removed = 1;
+	// "[...]" that is never entered takes its body with it
+	for (;;) {
+		if (iter == NULL) {
+			if (depth == 0)
+				break;
+			iter = loops[--depth]->next;
+			continue;
+		}
+		removed++;
+		if (iter->loop != NULL) {
+			loops = brainfuck_optimize_reserve(loops, depth, &capacity, sizeof(BrainfuckInstruction *));
+			loops[depth++] = iter;
+			iter = iter->loop;
+			continue;
+		}
+		iter = iter->next;
+	}
+	free(loops);
+	instruction->type = 0;
+	return removed;
+}
+
+/*
+ * A list of instructions that is scanned for dead code, which is either the
+ * 	program or the body of a loop.
+ */
+typedef struct BrainfuckOptimizeFrame {
+	/*
+	 * What is known about the tape at the current instruction of the list.
+	 */
+	BrainfuckOptimizeTape tape;
+	/*
+	 * The pointer to the start of the list.
+	 */
+	BrainfuckInstruction **start;
+	/*
+	 * The loop of the list whose body is scanned, if any.
+	 */
+	BrainfuckInstruction *loop;
+} BrainfuckOptimizeFrame;
+
+/*
+ * Unlinks the instructions of the given list that are marked as removed and
+ * 	restores the links to the previous instructions of the others.
+ *
+ * @param state The state the instructions belong to.
+ * @param link The pointer to the start of the linked list of instructions.
+ */
+static void brainfuck_optimize_unlink(BrainfuckState *state, BrainfuckInstruction **link) {
+	BrainfuckInstruction *instruction;
+	BrainfuckInstruction *previous = NULL;
+	while ((instruction = *link) != NULL) {
+		if (instruction->type == 0) {
+			*link = instruction->next;
+			if (instruction->loop != NULL)
+				brainfuck_optimize_release(state, instruction->loop, 1);
+			brainfuck_optimize_release(state, instruction, 0);
+			continue;
+		}
+		instruction->previous = previous;
+		previous = instruction;
+		if (instruction->type == BRAINFUCK_TOKEN_LOOP_END)
+			break;
+		link = &instruction->next;
+	}
+}
+
+/*
+ * Removes the instructions of the given linked list that can not affect the
+ * 	program: loops that start at a cell that is known to be zero, such as
+ * 	comment loops at the start of the program and loops that directly
+ * 	follow another loop, writes that set a cell to the value it already
+ * 	has, additions and moves of zero and writes that are overwritten
+ * 	before the cell is read, such as additions before a clear. If cells do
+ * 	not wrap, additions are only removed when they are known to keep
+ * 	their cell in range, so that overflows are still reported. The bodies
+ * 	of the loops that are entered are kept on a stack on the heap,
+ * 	together with what is known about the tape in them.
+ *
+ * @param state The state the instructions belong to.
+ * @param link The pointer to the start of the linked list of instructions.
+ * @param start What is known about the tape at the start of the list.
+ * @return The amount of instructions that are removed.
+ */
+static int brainfuck_optimize_dead_list(BrainfuckState *state, BrainfuckInstruction **link,
+		const BrainfuckOptimizeTape *start) {
+	BrainfuckOptimizeFrame *frames = NULL;
+	BrainfuckOptimizeTape *tape;
+	BrainfuckInstruction *instruction;
+	BrainfuckOptimizeCell *cell;
+	size_t depth = 0;
+	size_t capacity = 0;
+	int removed = 0;
+	int i;
+	long amount;
+	long value;
+	frames = brainfuck_optimize_reserve(frames, 0, &capacity, sizeof(BrainfuckOptimizeFrame));
+	frames[0].tape = *start;
+	frames[0].start = link;
+	frames[0].loop = NULL;
+	tape = &frames[0].tape;
+	for (;;) {
+		instruction = *link;
+		if (instruction == NULL || instruction->type == BRAINFUCK_TOKEN_LOOP_END) {
+			// the removed instructions may precede the current one
+			brainfuck_optimize_unlink(state, frames[depth].start);
+			if (depth == 0)
+				break;
+			instruction = frames[--depth].loop;
+			tape = &frames[depth].tape;
+			// scans and loops leave the current cell zero, but anything else may change
+			brainfuck_optimize_forget(tape);
+			brainfuck_optimize_write(tape, 0, 0, NULL);
+			link = &instruction->next;
+			continue;
+		}
+		switch (instruction->type) {
+		case BRAINFUCK_TOKEN_NEXT:
+		case BRAINFUCK_TOKEN_PREVIOUS:
+			amount = brainfuck_optimize_amount(instruction);
+			if (amount == 0)
+				break;
+			for (i = 0; i < tape->count; i++)
+				tape->cells[i].offset -= amount;
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_TOKEN_PLUS:
+		case BRAINFUCK_TOKEN_MINUS:
+			amount = brainfuck_optimize_amount(instruction);
+			if (amount == 0)
+				break;
+			value = brainfuck_optimize_value(tape, instruction->offset);
+			cell = brainfuck_optimize_cell(tape, instruction->offset);
+			// "+-" and "+>-<+" leave the cell as it is, unless the first one leaves its range
+			if (cell != NULL && cell->store != NULL && brainfuck_optimize_is_add(cell->store) &&
+					brainfuck_optimize_amount(cell->store) + amount == 0 && (state->cell_wrap || value >= 0)) {
+				removed += brainfuck_optimize_kill(cell->store);
+				brainfuck_optimize_write(tape, instruction->offset, value < 0 ? -1 : value + amount, NULL);
+				break;
+			}
+			brainfuck_optimize_write(tape, instruction->offset, value < 0 ? -1 : value + amount, instruction);
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_INSTRUCTION_SET:
+			value = brainfuck_optimize_value(tape, instruction->offset);
+			if (value >= 0 && (unsigned long) value == instruction->difference)
+				break;
+			cell = brainfuck_optimize_cell(tape, instruction->offset);
+			// "+++[-]" only needs the clear, if the additions can not leave the range of the cell
+			if (cell != NULL && cell->store != NULL &&
+					(state->cell_wrap || value >= 0 || !brainfuck_optimize_is_add(cell->store)))
+				removed += brainfuck_optimize_kill(cell->store);
+			brainfuck_optimize_write(tape, instruction->offset, (long) instruction->difference, instruction);
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_INSTRUCTION_MUL:
+			value = brainfuck_optimize_value(tape, 0);
+			if (value == 0)
+				break;
+			amount = brainfuck_optimize_value(tape, instruction->offset);
+			brainfuck_optimize_read(tape, 0);
+			brainfuck_optimize_read(tape, instruction->offset);
+			if (value < 0 || amount < 0 || (long) instruction->difference < -255 ||
+					(long) instruction->difference > 255)
+				amount = -1;
+			else
+				amount += value * (long) instruction->difference;
+			brainfuck_optimize_write(tape, instruction->offset, amount, NULL);
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_TOKEN_OUTPUT:
+			brainfuck_optimize_read(tape, instruction->offset);
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_TOKEN_INPUT:
+			// the cell is left alone at the end of the input in some modes
+			brainfuck_optimize_read(tape, instruction->offset);
+			brainfuck_optimize_write(tape, instruction->offset, -1, NULL);
+			link = &instruction->next;
+			continue;
+		case BRAINFUCK_TOKEN_LOOP_START:
+			if (brainfuck_optimize_value(tape, 0) == 0)
+				break;
+			// the body knows nothing about the tape, since it may run more than once
+			frames = brainfuck_optimize_reserve(frames, depth + 1, &capacity, sizeof(BrainfuckOptimizeFrame));
+			frames[depth++].loop = instruction;
+			tape = &frames[depth].tape;
+			brainfuck_optimize_forget(tape);
+			frames[depth].start = &instruction->loop;
+			frames[depth].loop = NULL;
+			link = &instruction->loop;
+			continue;
+		default:
+			// scans and loops leave the current cell zero, but anything else may change
+			brainfuck_optimize_forget(tape);
+			brainfuck_optimize_write(tape, 0, 0, NULL);
+			link = &instruction->next;
+			continue;
+		}
+		removed += brainfuck_optimize_kill(instruction);
+		link = &instruction->next;
+	}
+	free(frames);
+	return removed;
+}
+
+/*
+ * Removes instructions that can not affect the program in the given state,
+ * 	tracking the values of cells through the program: loops that are
+ * 	never entered, such as comment loops at the start of the program and
+ * 	loops that directly follow another loop, additions that cancel out,
+ * 	writes that are overwritten before they are read and clears of cells
+ * 	that are already zero. The program is assumed to start on a tape of
+ * 	zeros. This pass can run after any of the other passes.
+ *
+ * @param state The state containing the instructions to optimize.
+ * @return The amount of instructions that are removed.
+ */
+int brainfuck_optimize_dead(BrainfuckState *state) {
+	BrainfuckOptimizeTape tape;
+	if (state == NULL)
+		return 0;
+	tape.count = 0;
+	tape.zero = 1;
+	int removed = brainfuck_optimize_dead_list(state, &state->root, &tape);
+	for (state->head = state->root; state->head != NULL && state->head->next != NULL; )
+		state->head = state->head->next;
+	return removed;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The largest amount of commands of a loop that is shown in a report.
+ */
+#define BRAINFUCK_PROFILE_EXCERPT 40
+
+/*
+ * The executions of a loop of a profiled program.
+ */
+typedef struct BrainfuckProfileLoop {
+	/*
+	 * The index of the operation that starts the loop.
+	 */
+	size_t start;
+	/*
+	 * The amount of times the loop is reached.
+	 */
+	unsigned long long entries;
+	/*
+	 * The amount of times the body of the loop is executed.
+	 */
+	unsigned long long iterations;
+	/*
+	 * The amount of operations that are executed in the loop, including those
+	 * 	in the loops it contains.
+	 */
+	unsigned long long total;
+	/*
+	 * The amount of operations that are executed in the loop itself.
+	 */
+	unsigned long long self;
+} BrainfuckProfileLoop;
+
+/*
+ * Orders loops by the amount of operations they execute themselves, most
+ * 	first, and then by their position in the program.
+ */
+static int brainfuck_profile_compare(const void *a, const void *b) {
+	const BrainfuckProfileLoop *first = (const BrainfuckProfileLoop *) a;
+	const BrainfuckProfileLoop *second = (const BrainfuckProfileLoop *) b;
+	if (first->self != second->self)
+		return first->self < second->self ? 1 : -1;
+	return first->start < second->start ? -1 : first->start > second->start;
+}
+
+/*
+ * Writes the commands of the loop at the given position of the source, up to
+ * 	<code>BRAINFUCK_PROFILE_EXCERPT</code> of them. Comments are left out.
+ *
+ * @param stream The stream to write to.
+ * @param source The source.
+ * @param length The length of the source.
+ * @param position The position of the loop.
+ */
+static void brainfuck_profile_excerpt(FILE *stream, const char *source, size_t length,
+		BrainfuckPosition position) {
+	size_t line = 1;
+	size_t column = 1;
+	size_t index = 0;
+	size_t depth = 0;
+	int written = 0;
+	char c;
+	if (position.line == 0) {
+		fputs("?", stream);
+		return;
+	}
+	while (index < length && (line < position.line || column < position.column)) {
+		if (source[index++] == '\n') {
+			line++;
+			column = 1;
+		} else {
+			column++;
+		}
+	}
+	for (; index < length; index++) {
+		c = source[index];
+		if (memchr("+-<>.,[]", c, 8) == NULL)
+			continue;
+		if (written == BRAINFUCK_PROFILE_EXCERPT) {
+			fputs("...", stream);
+			return;
+		}
+		fputc(c, stream);
+		written++;
+		if (c == BRAINFUCK_TOKEN_LOOP_START)
+			depth++;
+		else if (c == BRAINFUCK_TOKEN_LOOP_END && --depth == 0)
+			return;
+	}
+}
+
+/*
+ * Writes a report of the loops of the given program that execute the most
+ * 	operations, together with their source text, the amount of times
+ * 	they repeat and their share of all executed operations. Loops are
+ * 	ranked by the operations they execute themselves, without those of
+ * 	the loops they contain, which are shown as the total.
+ *
+ * @param stream The stream to write the report to.
+ * @param program The program, which must be compiled with positions.
+ * @param counts The counts returned by <code>brainfuck_profile_program</code>.
+ * @param source The source of the program.
+ * @param length The length of the source.
+ * @param top The largest amount of loops to report.
+ * @return <code>0</code> on success, <code>-1</code> if writing failed.
+ */
+int brainfuck_profile_report(FILE *stream, BrainfuckProgram *program, const unsigned long long *counts,
+		const char *source, size_t length, int top) {
+	BrainfuckProfileLoop *loops;
+	size_t *open;
+	unsigned long long *sums;
+	unsigned long long executed;
+	unsigned long long iterations = 0;
+	size_t count = 0;
+	size_t depth = 0;
+	size_t start;
+	size_t n;
+	int rank;
+	if (stream == NULL || program == NULL || program->positions == NULL || counts == NULL ||
+			(source == NULL && length > 0))
+		return -1;
+	/*
+	 * The operations of a loop are contiguous, so the amount it executes is
+	 * 	the difference of two prefix sums.
+	 */
+	loops = malloc(sizeof(BrainfuckProfileLoop) * program->length);
+	open = malloc(sizeof(size_t) * program->length);
+	sums = malloc(sizeof(unsigned long long) * (program->length + 1));
+	if (loops == NULL || open == NULL || sums == NULL) {
+		free(loops);
+		free(open);
+		free(sums);
+		return -1;
+	}
+	sums[0] = 0;
+	for (n = 0; n < program->length; n++)
+		sums[n + 1] = sums[n] + counts[n];
+	executed = sums[program->length];
+	for (n = 0; n < program->length; n++) {
+		switch (program->operations[n].opcode) {
+		case BRAINFUCK_OP_JUMP_ZERO:
+			loops[count].start = n;
+			loops[count].self = 0;
+			open[depth++] = count++;
+			break;
+		case BRAINFUCK_OP_JUMP_NONZERO:
+			if (depth == 0)
+				break;
+			BrainfuckProfileLoop *loop = &loops[open[--depth]];
+			start = loop->start;
+			loop->entries = counts[start];
+			loop->iterations = counts[n];
+			loop->total = sums[n + 1] - sums[start];
+			// self holds the totals of the loops inside until now
+			loop->self = loop->total - loop->self;
+			if (depth > 0)
+				loops[open[depth - 1]].self += loop->total;
+			iterations += loop->iterations;
+			break;
+		}
+	}
+	qsort(loops, count, sizeof(BrainfuckProfileLoop), &brainfuck_profile_compare);
+	fprintf(stream, "profile: %llu operations executed, %llu loop iterations\n", executed, iterations);
+	if (count > 0)
+		fprintf(stream, "%4s  %-13s %7s %7s %12s %12s  %s\n",
+				"rank", "position", "self", "total", "entries", "iterations", "loop");
+	for (rank = 0; rank < top && (size_t) rank < count; rank++) {
+		BrainfuckProfileLoop *loop = &loops[rank];
+		BrainfuckPosition position = program->positions[loop->start];
+		char where[32];
+		snprintf(where, sizeof(where), "%u:%u", position.line, position.column);
+		fprintf(stream, "%4d  %-13s %6.2f%% %6.2f%% %12llu %12llu  ", rank + 1, where,
+				executed ? 100.0 * (double) loop->self / (double) executed : 0.0,
+				executed ? 100.0 * (double) loop->total / (double) executed : 0.0,
+				loop->entries, loop->iterations);
+		brainfuck_profile_excerpt(stream, source, length, position);
+		fputc('\n', stream);
+	}
+	free(loops);
+	free(open);
+	free(sums);
+	return ferror(stream) ? -1 : 0;
+}
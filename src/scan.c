@@ -0,0 +1,178 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && \
+		(defined(__GNUC__) || defined(__clang__))
+#	define BRAINFUCK_SCAN_X86 1
+#	include <immintrin.h>
+#endif
+
+/*
+ * The amount of cells that are checked one by one before a vectorized kernel
+ * 	is used, since most scans end within a few cells.
+ */
+#define BRAINFUCK_SCAN_PROBES 4
+
+/*
+ * Finds the next zero cell one cell at a time.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or the first index that is out of bounds.
+ */
+static long brainfuck_scan_scalar(const char *tape, long size, long index, long stride) {
+	while (index >= 0 && index < size && tape[index])
+		index += stride;
+	return index;
+}
+
+#ifdef BRAINFUCK_SCAN_X86
+/*
+ * Computes the bit mask that selects the cells of a vector window that lie on
+ * 	the stride, and the amount of cells the window advances by.
+ *
+ * @param width The amount of cells in a vector.
+ * @param stride The absolute stride of the scan, at most <code>width</code>.
+ * @param backward Whether the window ends at, rather than starts at, the
+ *	current index.
+ * @param step The pointer that will hold the amount to advance by.
+ * @return The bit mask.
+ */
+static unsigned int brainfuck_scan_mask(int width, long stride, int backward, long *step) {
+	unsigned int mask = 0;
+	long position;
+	*step = 0;
+	for (position = 0; position < width; position += stride) {
+		mask |= 1u << (backward ? width - 1 - position : position);
+		*step += stride;
+	}
+	return mask;
+}
+
+/*
+ * Finds the next zero cell using 16-byte SSE2 compares. The stride may be
+ * 	negative and its absolute value must not exceed 16.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or the first index that is out of bounds.
+ */
+static long brainfuck_scan_sse2(const char *tape, long size, long index, long stride) {
+	const __m128i zero = _mm_setzero_si128();
+	long step;
+	unsigned int bits;
+	unsigned int mask = brainfuck_scan_mask(16, stride < 0 ? -stride : stride, stride < 0, &step);
+	if (stride > 0) {
+		while (index + 16 <= size) {
+			bits = _mm_movemask_epi8(_mm_cmpeq_epi8(
+					_mm_loadu_si128((const __m128i *) (tape + index)), zero)) & mask;
+			if (bits)
+				return index + __builtin_ctz(bits);
+			index += step;
+		}
+	} else {
+		while (index - 15 >= 0 && index < size) {
+			bits = _mm_movemask_epi8(_mm_cmpeq_epi8(
+					_mm_loadu_si128((const __m128i *) (tape + index - 15)), zero)) & mask;
+			if (bits)
+				return index - 15 + (31 - __builtin_clz(bits));
+			index -= step;
+		}
+	}
+	return brainfuck_scan_scalar(tape, size, index, stride);
+}
+
+/*
+ * Finds the next zero cell using 32-byte AVX2 compares. The stride may be
+ * 	negative and its absolute value must not exceed 32.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or the first index that is out of bounds.
+ */
+__attribute__((target("avx2")))
+static long brainfuck_scan_avx2(const char *tape, long size, long index, long stride) {
+	const __m256i zero = _mm256_setzero_si256();
+	long step;
+	unsigned int bits;
+	unsigned int mask = brainfuck_scan_mask(32, stride < 0 ? -stride : stride, stride < 0, &step);
+	if (stride > 0) {
+		while (index + 32 <= size) {
+			bits = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+					_mm256_loadu_si256((const __m256i *) (tape + index)), zero)) & mask;
+			if (bits)
+				return index + __builtin_ctz(bits);
+			index += step;
+		}
+	} else {
+		while (index - 31 >= 0 && index < size) {
+			bits = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+					_mm256_loadu_si256((const __m256i *) (tape + index - 31)), zero)) & mask;
+			if (bits)
+				return index - 31 + (31 - __builtin_clz(bits));
+			index -= step;
+		}
+	}
+	return brainfuck_scan_scalar(tape, size, index, stride);
+}
+#endif
+
+/*
+ * Finds the next zero cell on the tape, starting at the given index and moving
+ * 	by the given stride. Vectorized kernels are selected at runtime based on
+ * 	the features of the processor.
+ *
+ * @param tape The tape to scan.
+ * @param size The size of the tape.
+ * @param index The index to start scanning at.
+ * @param stride The amount of cells to move after each cell that is not zero.
+ * @return The index of the zero cell or, if the scan runs off the tape, the
+ *	first index that is out of bounds.
+ */
+long brainfuck_scan(const char *tape, size_t size, long index, long stride) {
+	const char *found;
+	int probe;
+	for (probe = 0; probe < BRAINFUCK_SCAN_PROBES; probe++) {
+		if (index < 0 || (size_t) index >= size || !tape[index])
+			return index;
+		index += stride;
+	}
+	if (index < 0 || (size_t) index >= size)
+		return index;
+	if (stride == 1) {
+		found = memchr(tape + index, 0, size - index);
+		return found != NULL ? found - tape : (long) size;
+	}
+#ifdef BRAINFUCK_SCAN_X86
+	if ((stride <= 32 && stride >= -32) && __builtin_cpu_supports("avx2"))
+		return brainfuck_scan_avx2(tape, (long) size, index, stride);
+	if (stride <= 16 && stride >= -16)
+		return brainfuck_scan_sse2(tape, (long) size, index, stride);
+#endif
+	return brainfuck_scan_scalar(tape, (long) size, index, stride);
+}
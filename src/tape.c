@@ -0,0 +1,778 @@
+/*
+ * Copyright 2014 Fabian M.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#	define BRAINFUCK_GUARD 1
+#	include <signal.h>
+#	include <setjmp.h>
+#	include <pthread.h>
+#	include <sys/mman.h>
+#	include <unistd.h>
+#	include <fcntl.h>
+#	include <stdint.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/brainfuck.h"
+
+/*
+ * The amount of pages of a tape that are grouped together in a checkpoint, so
+ * 	that groups that do not change are shared as a whole.
+ */
+#define BRAINFUCK_CHECKPOINT_LEAF 512
+
+#ifdef BRAINFUCK_GUARD
+#ifndef MAP_ANONYMOUS
+#	define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#	define MAP_NORESERVE 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define BRAINFUCK_THREAD_LOCAL __thread
+#else
+#	define BRAINFUCK_THREAD_LOCAL
+#endif
+
+/*
+ * Describes the virtual tape a guarded run executes on.
+ */
+typedef struct BrainfuckGuard {
+	/*
+	 * The start of the reserved memory, including the guard regions.
+	 */
+	const char *low;
+	/*
+	 * The end of the reserved memory.
+	 */
+	const char *high;
+	/*
+	 * The first cell of the tape.
+	 */
+	const char *tape;
+	/*
+	 * The address that is accessed out of bounds.
+	 */
+	const char *fault;
+	/*
+	 * The point the fault handler returns to.
+	 */
+	sigjmp_buf jump;
+} BrainfuckGuard;
+
+/*
+ * The guarded run of the current thread, or <code>NULL</code>.
+ */
+static BRAINFUCK_THREAD_LOCAL BrainfuckGuard *brainfuck_guard_current;
+
+/*
+ * The handlers that were installed before ours.
+ */
+static struct sigaction brainfuck_guard_previous_segv;
+static struct sigaction brainfuck_guard_previous_bus;
+static volatile sig_atomic_t brainfuck_guard_installed = 0;
+static pthread_mutex_t brainfuck_guard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Tracks which pages of a virtual tape are written since its last checkpoint.
+ * 	The tape is write protected when a checkpoint is taken and every page
+ * 	is made writable again by the fault handler on its first write.
+ */
+typedef struct BrainfuckTapeTrack {
+	/*
+	 * The tape, or <code>NULL</code> if this entry is unused.
+	 */
+	char *volatile low;
+	char *volatile high;
+	/*
+	 * A flag for every page and for every group of pages that is set once it
+	 * 	is written.
+	 */
+	volatile unsigned char *pages;
+	volatile unsigned char *leaves;
+	/*
+	 * Set if a page could not be made writable on its own, in which case the
+	 * 	whole tape is writable and all pages count as written.
+	 */
+	volatile sig_atomic_t overflow;
+	/*
+	 * The next entry. Entries are never freed, since the fault handler may
+	 * 	walk the list at any time, but reused.
+	 */
+	struct BrainfuckTapeTrack *next;
+} BrainfuckTapeTrack;
+
+/*
+ * The tapes whose writes are tracked.
+ */
+static BrainfuckTapeTrack *volatile brainfuck_track_list;
+
+/*
+ * Records a write to a tracked tape that hit a write protected page.
+ *
+ * @param address The address that is written.
+ * @return <code>1</code> if the write can be retried, <code>0</code> if the
+ *	address is not part of a tracked tape.
+ */
+static int brainfuck_track_fault(const char *address) {
+	BrainfuckTapeTrack *track;
+	const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t index;
+	for (track = brainfuck_track_list; track != NULL; track = track->next) {
+		if (address < track->low || address >= track->high)
+			continue;
+		index = (size_t) (address - track->low) / page;
+		track->pages[index] = 1;
+		track->leaves[index / BRAINFUCK_CHECKPOINT_LEAF] = 1;
+		if (mprotect(track->low + index * page, page, PROT_READ | PROT_WRITE) == 0)
+			return 1;
+		// the tape may be split into too many mappings, so give up on single pages
+		if (mprotect(track->low, (size_t) (track->high - track->low), PROT_READ | PROT_WRITE) < 0)
+			return 0;
+		track->overflow = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Handles a memory fault. Writes to tracked tapes are recorded and retried,
+ * 	faults in the guard regions of the current run return to the run, and
+ * 	other faults are passed on to the handlers that were installed before
+ * 	by retrying the access with those handlers.
+ *
+ * @param signal The signal.
+ * @param info The information about the fault.
+ * @param ucontext The interrupted context.
+ */
+static void brainfuck_guard_handler(int signal, siginfo_t *info, void *ucontext) {
+	BrainfuckGuard *guard = brainfuck_guard_current;
+	const char *address = (const char *) info->si_addr;
+	(void) ucontext;
+	if (brainfuck_track_fault(address))
+		return;
+	if (guard != NULL && address >= guard->low && address < guard->high) {
+		guard->fault = address;
+		siglongjmp(guard->jump, 1);
+	}
+	sigaction(SIGSEGV, &brainfuck_guard_previous_segv, NULL);
+	sigaction(SIGBUS, &brainfuck_guard_previous_bus, NULL);
+	brainfuck_guard_installed = 0;
+	(void) signal;
+}
+
+/*
+ * Installs the fault handler if it is not yet installed. Contexts may be created
+ * 	on several threads at once, so this is serialized.
+ *
+ * @return <code>0</code> on success, <code>-1</code> on failure.
+ */
+static int brainfuck_guard_install(void) {
+	struct sigaction action;
+	int result = 0;
+	pthread_mutex_lock(&brainfuck_guard_lock);
+	if (!brainfuck_guard_installed) {
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = &brainfuck_guard_handler;
+		action.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&action.sa_mask);
+		if (sigaction(SIGSEGV, &action, &brainfuck_guard_previous_segv) < 0 ||
+				sigaction(SIGBUS, &action, &brainfuck_guard_previous_bus) < 0)
+			result = -1;
+		else
+			brainfuck_guard_installed = 1;
+	}
+	pthread_mutex_unlock(&brainfuck_guard_lock);
+	return result;
+}
+
+/*
+ * Starts tracking the writes to the virtual tape of the given context.
+ *
+ * @param context The context.
+ * @param size The size of the tape in bytes.
+ * @param page The size of a page.
+ * @return <code>0</code> on success, <code>-1</code> if the writes cannot be
+ *	tracked.
+ */
+static int brainfuck_track_start(BrainfuckExecutionContext *context, size_t size, size_t page) {
+	const size_t pages = size / page;
+	BrainfuckTapeTrack *track;
+	unsigned char *flags;
+	unsigned char *leaves;
+	if (size % page != 0 || (size_t) context->tape % page != 0 || brainfuck_guard_install() < 0)
+		return -1;
+	flags = calloc(pages, 1);
+	leaves = calloc(pages / BRAINFUCK_CHECKPOINT_LEAF + 1, 1);
+	if (flags == NULL || leaves == NULL) {
+		free(flags);
+		free(leaves);
+		return -1;
+	}
+	pthread_mutex_lock(&brainfuck_guard_lock);
+	for (track = brainfuck_track_list; track != NULL && track->high != NULL; track = track->next);
+	if (track == NULL && (track = calloc(1, sizeof(BrainfuckTapeTrack))) != NULL) {
+		track->next = brainfuck_track_list;
+		__sync_synchronize();
+		brainfuck_track_list = track;
+	}
+	if (track != NULL) {
+		track->pages = flags;
+		track->leaves = leaves;
+		track->overflow = 0;
+		track->low = context->tape;
+		__sync_synchronize();
+		track->high = context->tape + size;
+	}
+	pthread_mutex_unlock(&brainfuck_guard_lock);
+	if (track == NULL) {
+		free(flags);
+		free(leaves);
+		return -1;
+	}
+	context->tape_track = track;
+	return 0;
+}
+
+/*
+ * Forgets the written pages of a tracked tape and write protects it.
+ *
+ * @param track The tracked tape.
+ */
+static void brainfuck_track_protect(BrainfuckTapeTrack *track) {
+	const size_t size = (size_t) (track->high - track->low);
+	const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	memset((void *) track->pages, 0, size / page);
+	memset((void *) track->leaves, 0, size / page / BRAINFUCK_CHECKPOINT_LEAF + 1);
+	track->overflow = mprotect(track->low, size, PROT_READ) < 0;
+}
+
+/*
+ * Stops tracking the writes to a tape and makes it writable again.
+ *
+ * @param track The tracked tape.
+ */
+static void brainfuck_track_stop(BrainfuckTapeTrack *track) {
+	mprotect(track->low, (size_t) (track->high - track->low), PROT_READ | PROT_WRITE);
+	pthread_mutex_lock(&brainfuck_guard_lock);
+	track->high = NULL;
+	__sync_synchronize();
+	track->low = NULL;
+	free((void *) track->pages);
+	free((void *) track->leaves);
+	track->pages = NULL;
+	track->leaves = NULL;
+	pthread_mutex_unlock(&brainfuck_guard_lock);
+}
+#endif
+
+/*
+ * Creates a new context with a virtual tape. The tape extends
+ * 	<code>BRAINFUCK_VIRTUAL_TAPE_SIZE / 2</code> cells in both directions
+ * 	from the starting cell, and its pages are only committed once they are
+ * 	touched. Room is reserved for the widest cells, but only the cells of
+ * 	the current width are accessible, so the width of the cells may be
+ * 	changed before the tape is used. The tape is surrounded by guard
+ * 	regions that catch accesses out of bounds, so compiled programs run
+ * 	without bounds checks.
+ *
+ * @return The new context or <code>NULL</code> if virtual tapes are not
+ *	supported on this platform.
+ */
+BrainfuckExecutionContext * brainfuck_context_virtual(void) {
+#ifdef BRAINFUCK_GUARD
+	const size_t size = (size_t) BRAINFUCK_VIRTUAL_TAPE_SIZE;
+	const size_t bytes = size * sizeof(BRAINFUCK_CELL_TYPE);
+	const size_t guard = (size_t) BRAINFUCK_TAPE_GUARD_SIZE;
+	BrainfuckExecutionContext *context;
+	char *map = mmap(NULL, bytes + 2 * guard, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+	// new contexts have 8-bit cells
+	if (mprotect(map + guard, size, PROT_READ | PROT_WRITE) < 0 || brainfuck_guard_install() < 0 ||
+			(context = brainfuck_context(0)) == NULL) {
+		munmap(map, bytes + 2 * guard);
+		return NULL;
+	}
+	free(context->tape);
+	context->tape = map + guard;
+	context->tape_size = size;
+	context->tape_index = (int) (size / 2);
+	context->tape_map = map;
+	context->tape_map_size = bytes + 2 * guard;
+	context->tape_map_bits = 8;
+	return context;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Fits the accessible part of the virtual tape of the given context to the
+ * 	current width of its cells, so that the guard region follows the last
+ * 	cell. Writes are no longer tracked if the width changes, since the
+ * 	tracked pages no longer cover the tape.
+ *
+ * @param context The context.
+ */
+void brainfuck_guard_fit(BrainfuckExecutionContext *context) {
+#ifdef BRAINFUCK_GUARD
+	const size_t bytes = (size_t) context->tape_size * (size_t) (context->cell_bits / 8);
+	const size_t fitted = (size_t) context->tape_size * (size_t) (context->tape_map_bits / 8);
+	if (context->tape_map == NULL || context->tape_map_bits == context->cell_bits)
+		return;
+	if (context->tape_track != NULL) {
+		brainfuck_track_stop(context->tape_track);
+		context->tape_track = NULL;
+	}
+	if (bytes > fitted ? mprotect(context->tape + fitted, bytes - fitted, PROT_READ | PROT_WRITE) < 0 :
+			mprotect(context->tape + bytes, fitted - bytes, PROT_NONE) < 0)
+		return;
+	context->tape_map_bits = context->cell_bits;
+#else
+	(void) context;
+#endif
+}
+
+/*
+ * Executes the given compiled program with the given engine on the virtual tape
+ * 	of the given context. Accesses that hit a guard region are reported
+ * 	as out of bounds.
+ *
+ * @param program The program you want to execute.
+ * @param context The context, which must have a virtual tape.
+ * @param engine The engine to execute the program with.
+ */
+void brainfuck_guard_run(BrainfuckProgram *program, BrainfuckExecutionContext *context,
+		BrainfuckProgramEngine engine) {
+#ifdef BRAINFUCK_GUARD
+	BrainfuckGuard guard;
+	BrainfuckGuard *previous = brainfuck_guard_current;
+	const long width = context->cell_bits / 8;
+	long offset;
+	guard.low = (const char *) context->tape_map;
+	guard.high = guard.low + context->tape_map_size;
+	guard.tape = context->tape;
+	guard.fault = NULL;
+	if (sigsetjmp(guard.jump, 1) == 0) {
+		brainfuck_guard_current = &guard;
+		engine(program, context);
+		brainfuck_guard_current = previous;
+		return;
+	}
+	brainfuck_guard_current = previous;
+	// round towards the cell the faulting byte belongs to, also below the tape
+	offset = (long) (guard.fault - guard.tape);
+	brainfuck_out_of_bounds(context, offset < 0 ? -1 - (-offset - 1) / width : offset / width);
+#else
+	engine(program, context);
+#endif
+}
+
+/*
+ * Forgets the guarded run of the current thread. This is done before an error
+ * 	handler is invoked, since it may leave the run without returning.
+ */
+void brainfuck_guard_abandon(void) {
+#ifdef BRAINFUCK_GUARD
+	brainfuck_guard_current = NULL;
+#endif
+}
+
+/*
+ * A page of a checkpoint, which may be shared between checkpoints.
+ */
+typedef struct BrainfuckCheckpointPage {
+	int references;
+	char data[];
+} BrainfuckCheckpointPage;
+
+/*
+ * A group of pages of a checkpoint, <code>NULL</code> for pages that are
+ * 	zero. Groups may be shared between checkpoints as well.
+ */
+typedef struct BrainfuckCheckpointLeaf {
+	int references;
+	BrainfuckCheckpointPage *pages[BRAINFUCK_CHECKPOINT_LEAF];
+} BrainfuckCheckpointLeaf;
+
+/*
+ * Returns the size of the pages checkpoints are made of.
+ */
+static size_t brainfuck_checkpoint_page_size(void) {
+#ifdef BRAINFUCK_GUARD
+	long page = sysconf(_SC_PAGESIZE);
+	if (page > 0)
+		return (size_t) page;
+#endif
+	return 4096;
+}
+
+/*
+ * Returns the page with the given index of a checkpoint, which is
+ * 	<code>NULL</code> if it is zero.
+ */
+static BrainfuckCheckpointPage * brainfuck_checkpoint_page(const BrainfuckCheckpoint *checkpoint, size_t index) {
+	const BrainfuckCheckpointLeaf *leaf = checkpoint->leaves[index / BRAINFUCK_CHECKPOINT_LEAF];
+	return leaf != NULL ? leaf->pages[index % BRAINFUCK_CHECKPOINT_LEAF] : NULL;
+}
+
+/*
+ * Drops a reference to a page of a checkpoint.
+ */
+static void brainfuck_checkpoint_drop(BrainfuckCheckpointPage *page) {
+	if (page != NULL && --page->references == 0)
+		free(page);
+}
+
+/*
+ * Determines whether the pages with the given index of the tape of a context
+ * 	and its last checkpoint may differ.
+ *
+ * @param context The context.
+ * @param index The index of the page.
+ * @param leaf <code>1</code> if the index is that of a group of pages.
+ * @return <code>1</code> if the tape may be written, <code>0</code> if it is
+ *	known to be unchanged.
+ */
+static int brainfuck_checkpoint_written(const BrainfuckExecutionContext *context, size_t index, int leaf) {
+#ifdef BRAINFUCK_GUARD
+	const BrainfuckTapeTrack *track = context->tape_track;
+	if (track != NULL && !track->overflow && context->checkpoint != NULL)
+		return leaf ? track->leaves[index] : track->pages[index];
+#else
+	(void) index;
+	(void) leaf;
+#endif
+	(void) context;
+	return 1;
+}
+
+/*
+ * Opens the page map of the process, which tells which pages of a virtual
+ * 	tape are ever touched, if the tape of the given context is virtual
+ * 	and its writes are not tracked.
+ *
+ * @param context The context.
+ * @return The descriptor of the page map or <code>-1</code>.
+ */
+static int brainfuck_checkpoint_open_map(const BrainfuckExecutionContext *context) {
+#if defined(BRAINFUCK_GUARD) && defined(__linux__)
+	if (context->tape_map != NULL && (context->checkpoint == NULL || context->tape_track == NULL ||
+			context->tape_track->overflow))
+		return open("/proc/self/pagemap", O_RDONLY);
+#else
+	(void) context;
+#endif
+	return -1;
+}
+
+/*
+ * Closes the page map opened by <code>brainfuck_checkpoint_open_map</code>.
+ */
+static void brainfuck_checkpoint_close_map(int descriptor) {
+#ifdef BRAINFUCK_GUARD
+	if (descriptor >= 0)
+		close(descriptor);
+#else
+	(void) descriptor;
+#endif
+}
+
+/*
+ * Finds the pages of a group of pages of a virtual tape that are never touched,
+ * 	which are zero. Reading them would map every page of the tape.
+ *
+ * @param descriptor The descriptor of the page map.
+ * @param data The first page.
+ * @param page The size of a page.
+ * @param count The amount of pages.
+ * @param zero Set for every page that is known to be zero.
+ * @return <code>0</code> on success, <code>-1</code> if it is not known.
+ */
+static int brainfuck_checkpoint_untouched(int descriptor, const char *data, size_t page, size_t count,
+		unsigned char *zero) {
+#if defined(BRAINFUCK_GUARD) && defined(__linux__)
+	uint64_t entries[BRAINFUCK_CHECKPOINT_LEAF];
+	const off_t offset = (off_t) ((uintptr_t) data / page * sizeof(uint64_t));
+	size_t n;
+	if (descriptor < 0 || pread(descriptor, entries, count * sizeof(uint64_t), offset) !=
+			(ssize_t) (count * sizeof(uint64_t)))
+		return -1;
+	// a page that is neither present nor swapped out is never written
+	for (n = 0; n < count; n++)
+		zero[n] = (entries[n] >> 62) == 0;
+	return 0;
+#else
+	(void) descriptor;
+	(void) data;
+	(void) page;
+	(void) count;
+	(void) zero;
+	return -1;
+#endif
+}
+
+/*
+ * Write protects the tape of the given context so that the pages that are
+ * 	written from now on are known, if the tape is virtual.
+ *
+ * @param context The context.
+ * @param size The size of the tape in bytes.
+ * @param page The size of a page.
+ */
+static void brainfuck_checkpoint_track(BrainfuckExecutionContext *context, size_t size, size_t page) {
+#ifdef BRAINFUCK_GUARD
+	if (context->tape_track == NULL && (context->tape_map == NULL ||
+			brainfuck_track_start(context, size, page) < 0))
+		return;
+	brainfuck_track_protect(context->tape_track);
+#else
+	(void) context;
+	(void) size;
+	(void) page;
+#endif
+}
+
+/*
+ * Takes a checkpoint of the given context that shares the pages which did not
+ * 	change with the previous checkpoint.
+ *
+ * @param context The context.
+ * @return The checkpoint or <code>NULL</code> if it could not be allocated.
+ */
+BrainfuckCheckpoint * brainfuck_checkpoint(BrainfuckExecutionContext *context) {
+	BrainfuckCheckpointPage *slots[BRAINFUCK_CHECKPOINT_LEAF];
+	unsigned char zero[BRAINFUCK_CHECKPOINT_LEAF];
+	BrainfuckCheckpointPage *page;
+	BrainfuckCheckpointLeaf *leaf;
+	BrainfuckCheckpoint *previous;
+	BrainfuckCheckpoint *checkpoint;
+	size_t size, page_size, pages, length, index, n, i;
+	int changed, map;
+	const char *data;
+	if (context == NULL || context->tape == NULL)
+		return NULL;
+	brainfuck_flush(context);
+	brainfuck_guard_fit(context);
+	size = (size_t) context->tape_size * (size_t) (context->cell_bits / 8);
+	page_size = brainfuck_checkpoint_page_size();
+	pages = (size + page_size - 1) / page_size;
+	checkpoint = malloc(sizeof(BrainfuckCheckpoint));
+	if (checkpoint == NULL)
+		return NULL;
+	checkpoint->references = 1;
+	checkpoint->size = size;
+	checkpoint->page_size = page_size;
+	checkpoint->leaf_count = (pages + BRAINFUCK_CHECKPOINT_LEAF - 1) / BRAINFUCK_CHECKPOINT_LEAF;
+	checkpoint->leaves = calloc(checkpoint->leaf_count + 1, sizeof(BrainfuckCheckpointLeaf *));
+	if (checkpoint->leaves == NULL) {
+		free(checkpoint);
+		return NULL;
+	}
+	checkpoint->tape_index = context->tape_index;
+	checkpoint->cell_bits = context->cell_bits;
+	checkpoint->program_counter = context->program_counter;
+	checkpoint->input_pending = context->input_pending;
+	checkpoint->input = context->input;
+	checkpoint->input_length = context->input_length;
+	checkpoint->input_position = context->input_position;
+	previous = context->checkpoint;
+	if (previous != NULL && (previous->size != size || previous->page_size != page_size))
+		previous = NULL;
+	map = brainfuck_checkpoint_open_map(context);
+	for (n = 0; n < checkpoint->leaf_count; n++) {
+		if (previous != NULL && !brainfuck_checkpoint_written(context, n, 1)) {
+			if ((checkpoint->leaves[n] = previous->leaves[n]) != NULL)
+				checkpoint->leaves[n]->references++;
+			continue;
+		}
+		changed = 0;
+		index = n * BRAINFUCK_CHECKPOINT_LEAF;
+		if (brainfuck_checkpoint_untouched(map, context->tape + index * page_size, page_size,
+				pages - index < BRAINFUCK_CHECKPOINT_LEAF ? pages - index : BRAINFUCK_CHECKPOINT_LEAF, zero) < 0)
+			memset(zero, 0, sizeof(zero));
+		for (i = 0; i < BRAINFUCK_CHECKPOINT_LEAF; i++) {
+			index = n * BRAINFUCK_CHECKPOINT_LEAF + i;
+			page = previous != NULL && index < pages ? brainfuck_checkpoint_page(previous, index) : NULL;
+			if (index < pages && zero[i]) {
+				changed |= page != NULL;
+				page = NULL;
+			} else if (index < pages && (previous == NULL || brainfuck_checkpoint_written(context, index, 0))) {
+				data = context->tape + index * page_size;
+				length = size - index * page_size < page_size ? size - index * page_size : page_size;
+				// a page equals the previous one, or is zero if there is none
+				if (page != NULL ? memcmp(page->data, data, length) != 0 :
+						data[0] != 0 || memcmp(data, data + 1, length - 1) != 0) {
+					page = malloc(sizeof(BrainfuckCheckpointPage) + page_size);
+					if (page == NULL) {
+						while (i > 0)
+							brainfuck_checkpoint_drop(slots[--i]);
+						brainfuck_checkpoint_close_map(map);
+						brainfuck_destroy_checkpoint(checkpoint);
+						return NULL;
+					}
+					page->references = 0;
+					memcpy(page->data, data, length);
+					changed = 1;
+				}
+			}
+			if ((slots[i] = page) != NULL)
+				page->references++;
+		}
+		if (previous != NULL && !changed) {
+			for (i = 0; i < BRAINFUCK_CHECKPOINT_LEAF; i++)
+				brainfuck_checkpoint_drop(slots[i]);
+			if ((checkpoint->leaves[n] = previous->leaves[n]) != NULL)
+				checkpoint->leaves[n]->references++;
+			continue;
+		}
+		for (i = 0; i < BRAINFUCK_CHECKPOINT_LEAF && slots[i] == NULL; i++);
+		if (i == BRAINFUCK_CHECKPOINT_LEAF)
+			continue;
+		leaf = malloc(sizeof(BrainfuckCheckpointLeaf));
+		if (leaf == NULL) {
+			for (i = 0; i < BRAINFUCK_CHECKPOINT_LEAF; i++)
+				brainfuck_checkpoint_drop(slots[i]);
+			brainfuck_checkpoint_close_map(map);
+			brainfuck_destroy_checkpoint(checkpoint);
+			return NULL;
+		}
+		leaf->references = 1;
+		memcpy(leaf->pages, slots, sizeof(slots));
+		checkpoint->leaves[n] = leaf;
+	}
+	brainfuck_checkpoint_close_map(map);
+	brainfuck_checkpoint_track(context, size, page_size);
+	// the context keeps a reference to share pages with the next checkpoint
+	checkpoint->references++;
+	brainfuck_destroy_checkpoint(context->checkpoint);
+	context->checkpoint = checkpoint;
+	return checkpoint;
+}
+
+/*
+ * Restores the given checkpoint into the given context.
+ *
+ * @param context The context.
+ * @param checkpoint The checkpoint.
+ * @return <code>0</code> on success, <code>-1</code> if the checkpoint does
+ *	not fit the context.
+ */
+int brainfuck_restore(BrainfuckExecutionContext *context, BrainfuckCheckpoint *checkpoint) {
+	BrainfuckCheckpoint *previous;
+	BrainfuckCheckpointPage *page;
+	size_t size, pages, length, index, n;
+	int zero = 0;
+	char *data;
+	if (context == NULL || checkpoint == NULL || context->tape == NULL)
+		return -1;
+	brainfuck_guard_fit(context);
+	size = (size_t) context->tape_size * (size_t) (context->cell_bits / 8);
+	if (checkpoint->size != size || checkpoint->page_size != brainfuck_checkpoint_page_size() ||
+			checkpoint->cell_bits != context->cell_bits)
+		return -1;
+	brainfuck_flush(context);
+	pages = (size + checkpoint->page_size - 1) / checkpoint->page_size;
+	previous = context->checkpoint;
+	if (previous != NULL && previous->size != size)
+		previous = NULL;
+#ifdef BRAINFUCK_GUARD
+	if (context->tape_track != NULL)
+		mprotect(context->tape, size, PROT_READ | PROT_WRITE);
+	// a virtual tape that is not tracked is cheaper to drop than to compare
+	if (context->tape_map != NULL && (previous == NULL || context->tape_track == NULL ||
+			context->tape_track->overflow))
+		zero = madvise(context->tape, size, MADV_DONTNEED) == 0;
+#endif
+	for (n = 0; n < checkpoint->leaf_count; n++) {
+		if (zero ? checkpoint->leaves[n] == NULL : previous != NULL &&
+				previous->leaves[n] == checkpoint->leaves[n] && !brainfuck_checkpoint_written(context, n, 1))
+			continue;
+		for (index = n * BRAINFUCK_CHECKPOINT_LEAF; index < pages &&
+				index < (n + 1) * BRAINFUCK_CHECKPOINT_LEAF; index++) {
+			page = brainfuck_checkpoint_page(checkpoint, index);
+			if (zero ? page == NULL : previous != NULL && brainfuck_checkpoint_page(previous, index) == page &&
+					!brainfuck_checkpoint_written(context, index, 0))
+				continue;
+			data = context->tape + index * checkpoint->page_size;
+			length = size - index * checkpoint->page_size;
+			if (length > checkpoint->page_size)
+				length = checkpoint->page_size;
+			if (page != NULL)
+				memcpy(data, page->data, length);
+			else
+				memset(data, 0, length);
+		}
+	}
+	brainfuck_checkpoint_track(context, size, checkpoint->page_size);
+	context->tape_index = checkpoint->tape_index;
+	context->program_counter = checkpoint->program_counter;
+	context->input_pending = checkpoint->input_pending;
+	// input from a stream cannot be rewound
+	if (context->input == checkpoint->input && context->input_length == checkpoint->input_length &&
+			context->input != context->input_buffer)
+		context->input_position = checkpoint->input_position;
+	checkpoint->references++;
+	brainfuck_destroy_checkpoint(context->checkpoint);
+	context->checkpoint = checkpoint;
+	return 0;
+}
+
+/*
+ * Releases a checkpoint and the pages that are no longer shared.
+ *
+ * @param checkpoint The checkpoint to destroy.
+ */
+void brainfuck_destroy_checkpoint(BrainfuckCheckpoint *checkpoint) {
+	BrainfuckCheckpointLeaf *leaf;
+	size_t n, i;
+	if (checkpoint == NULL || --checkpoint->references > 0)
+		return;
+	for (n = 0; n < checkpoint->leaf_count; n++) {
+		leaf = checkpoint->leaves[n];
+		if (leaf == NULL || --leaf->references > 0)
+			continue;
+		for (i = 0; i < BRAINFUCK_CHECKPOINT_LEAF; i++)
+			brainfuck_checkpoint_drop(leaf->pages[i]);
+		free(leaf);
+	}
+	free(checkpoint->leaves);
+	free(checkpoint);
+}
+
+/*
+ * Stops tracking the tape of the given context and releases its last
+ * 	checkpoint.
+ *
+ * @param context The context.
+ */
+void brainfuck_checkpoint_release(BrainfuckExecutionContext *context) {
+	if (context == NULL)
+		return;
+#ifdef BRAINFUCK_GUARD
+	if (context->tape_track != NULL)
+		brainfuck_track_stop(context->tape_track);
+#endif
+	context->tape_track = NULL;
+	brainfuck_destroy_checkpoint(context->checkpoint);
+	context->checkpoint = NULL;
+}